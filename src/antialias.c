@@ -0,0 +1,292 @@
+#include "antialias.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+// Offsets of the samples of a pixel follow the R2 sequence, which covers
+// the square evenly for any number of samples, shifted by a hash of the
+// pixel so that neighbours don't repeat the same pattern.
+#define R2_X 0.7548776662466927
+#define R2_Y 0.5698402909980532
+
+// Samples `per_pixel` points of each of the `num_pixels` pixels, from sample
+// number `first` within the pixel, one batch per task.
+typedef struct {
+    const EngineParams* params;
+    unsigned int width;
+    double step;
+    double origin_x;
+    double origin_y;
+
+    const unsigned int* pixels;
+    unsigned int num_pixels;
+    unsigned int first;
+    unsigned int per_pixel;
+
+    int32_t* values;
+    float* magnitudes;
+} Sampling;
+
+// Sum over the channels of the differences between two colors.
+static unsigned int contrast(uint32_t a, uint32_t b) {
+    unsigned int sum = 0;
+    for (unsigned int shift = 0; shift < 24; shift += 8) {
+        int difference =
+            (int)((a >> shift) & 0xff) - (int)((b >> shift) & 0xff);
+        sum += abs(difference);
+    }
+    return sum;
+}
+
+// Marks the pixels of `colors` that differ from their right or bottom
+// neighbour, and the neighbour, and returns how many there are.
+static unsigned int find_edges(const uint32_t* colors,
+                               unsigned int width,
+                               unsigned int height,
+                               bool* edge) {
+    memset(edge, 0, (size_t)width * height);
+
+    // Every row also marks the one below it, so even rows go first and odd
+    // rows next, for no two threads to write to the same row at once.
+    for (unsigned int parity = 0; parity < 2; parity++) {
+#pragma omp parallel for
+        for (unsigned int y = parity; y < height; y += 2) {
+            for (unsigned int x = 0; x < width; x++) {
+                size_t index = (size_t)y * width + x;
+                if (x + 1 < width && contrast(colors[index],
+                                              colors[index + 1]) >
+                                         ANTIALIAS_CONTRAST) {
+                    edge[index] = true;
+                    edge[index + 1] = true;
+                }
+                if (y + 1 < height && contrast(colors[index],
+                                               colors[index + width]) >
+                                          ANTIALIAS_CONTRAST) {
+                    edge[index] = true;
+                    edge[index + width] = true;
+                }
+            }
+        }
+    }
+
+    unsigned int count = 0;
+    for (size_t index = 0; index < (size_t)width * height; index++) {
+        count += edge[index];
+    }
+    return count;
+}
+
+// Hash of a pixel, as a fraction in [0, 1).
+static double pixel_hash(uint32_t x, uint32_t y, uint32_t seed) {
+    uint32_t hash = x * 0x8da6b343 ^ y * 0xd8163841 ^ seed * 0xcb1ab31f;
+    hash ^= hash >> 16;
+    hash *= 0x7feb352d;
+    hash ^= hash >> 15;
+    return hash / 0x1p32;
+}
+
+static uint64_t sample_batch(void* data, unsigned int task) {
+    const Sampling* sampling = data;
+    if (engine_cancelled(sampling->params))
+        return 0;
+
+    size_t total = (size_t)sampling->num_pixels * sampling->per_pixel;
+    size_t first = (size_t)task * ENGINE_BATCH_SIZE;
+    unsigned int count = total - first < ENGINE_BATCH_SIZE
+                             ? total - first
+                             : ENGINE_BATCH_SIZE;
+
+    double re[ENGINE_BATCH_SIZE], im[ENGINE_BATCH_SIZE];
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int pixel = sampling->pixels[(first + i) /
+                                              sampling->per_pixel];
+        unsigned int sample =
+            sampling->first + (first + i) % sampling->per_pixel + 1;
+        unsigned int x = pixel % sampling->width;
+        unsigned int y = pixel / sampling->width;
+
+        double offset_x = pixel_hash(x, y, 0) + sample * R2_X;
+        double offset_y = pixel_hash(x, y, 1) + sample * R2_Y;
+        offset_x -= (int)offset_x + 0.5;
+        offset_y -= (int)offset_y + 0.5;
+
+        re[i] = (sampling->origin_x + x + offset_x) * sampling->step;
+        im[i] = -((sampling->origin_y + y + offset_y) * sampling->step);
+    }
+
+    uint64_t iterations = 0;
+    engine_sample_points(sampling->params,
+                         re,
+                         im,
+                         count,
+                         &sampling->values[first],
+                         &sampling->magnitudes[first],
+                         &iterations);
+    return iterations;
+}
+
+// Runs `sampling` on the threads, adding to `stats` unless it is NULL.
+static void sample(Sampling* sampling, EngineStats* stats) {
+    size_t total = (size_t)sampling->num_pixels * sampling->per_pixel;
+    SchedulerStats threads;
+    uint64_t iterations =
+        scheduler_run((total + ENGINE_BATCH_SIZE - 1) / ENGINE_BATCH_SIZE,
+                      sample_batch,
+                      sampling,
+                      &threads);
+
+    if (stats == NULL)
+        return;
+    stats->iterations += iterations;
+    stats->threads.num_threads = threads.num_threads;
+    for (unsigned int t = 0; t < threads.num_threads; t++) {
+        stats->threads.busy[t] += threads.busy[t];
+        stats->threads.tasks[t] += threads.tasks[t];
+        stats->threads.steals[t] += threads.steals[t];
+    }
+}
+
+bool antialias_frame(const EngineParams* params,
+                     EngineFrame* frame,
+                     EngineStats* stats) {
+    frame->num_edges = 0;
+    if (stats != NULL)
+        *stats = (EngineStats){0};
+
+    unsigned int samples = engine_antialias(params) - 1;
+    if (samples == 0)
+        return true;
+    unsigned int probes =
+        samples < ANTIALIAS_PROBES ? samples : ANTIALIAS_PROBES;
+
+    size_t num_pixels = (size_t)frame->width * frame->height;
+    uint32_t* colors = malloc(num_pixels * sizeof(uint32_t));
+    engine_colorize(params, frame, colors, frame->width);
+
+    bool* edge = malloc(num_pixels);
+    unsigned int num_edges =
+        find_edges(colors, frame->width, frame->height, edge);
+    unsigned int* edges = malloc(num_edges * sizeof(unsigned int));
+    unsigned int next = 0;
+    for (size_t index = 0; index < num_pixels; index++) {
+        if (edge[index])
+            edges[next++] = index;
+    }
+    free(edge);
+
+    EngineParams pass_params;
+    engine_pass_begin(params, &pass_params);
+
+    // Every edge gets its probes first.
+    size_t num_probes = (size_t)num_edges * probes;
+    Sampling probing = {
+        .params = &pass_params,
+        .width = frame->width,
+        .step = engine_step(params),
+        .pixels = edges,
+        .num_pixels = num_edges,
+        .first = 0,
+        .per_pixel = probes,
+        .values = malloc(num_probes * sizeof(int32_t)),
+        .magnitudes = malloc(num_probes * sizeof(float)),
+    };
+    engine_view_origin(params, &probing.origin_x, &probing.origin_y);
+    sample(&probing, stats);
+
+    // Then the rest of the samples go to the edges whose probes differ from
+    // the pixel.
+    uint32_t* probe_colors = malloc(num_probes * sizeof(uint32_t));
+    engine_color_samples(params,
+                         probing.values,
+                         probing.magnitudes,
+                         num_probes,
+                         probe_colors);
+
+    unsigned int* refined = malloc(num_edges * sizeof(unsigned int));
+    unsigned int num_refined = 0;
+    for (unsigned int i = 0; i < num_edges && probes < samples; i++) {
+        for (unsigned int j = 0; j < probes; j++) {
+            if (contrast(colors[edges[i]], probe_colors[i * probes + j]) >
+                ANTIALIAS_CONTRAST) {
+                refined[num_refined++] = i;
+                break;
+            }
+        }
+    }
+    free(probe_colors);
+    free(colors);
+
+    size_t num_rest = (size_t)num_refined * (samples - probes);
+    unsigned int* refined_pixels = malloc(num_refined * sizeof(unsigned int));
+    for (unsigned int i = 0; i < num_refined; i++) {
+        refined_pixels[i] = edges[refined[i]];
+    }
+    Sampling refining = probing;
+    refining.pixels = refined_pixels;
+    refining.num_pixels = num_refined;
+    refining.first = probes;
+    refining.per_pixel = samples - probes;
+    refining.values = malloc(num_rest * sizeof(int32_t));
+    refining.magnitudes = malloc(num_rest * sizeof(float));
+    if (!engine_cancelled(params))
+        sample(&refining, stats);
+    free(refined_pixels);
+
+    engine_pass_end(params, &pass_params);
+
+    bool cancelled = engine_cancelled(params);
+    if (!cancelled) {
+        // Lays the samples of every edge out one after the other.
+        size_t count = num_probes + num_rest;
+        if (count > frame->edge_samples_capacity) {
+            frame->edge_values =
+                realloc(frame->edge_values, count * sizeof(int32_t));
+            frame->edge_magnitudes =
+                realloc(frame->edge_magnitudes, count * sizeof(float));
+            frame->edge_samples_capacity = count;
+        }
+        frame->edges =
+            realloc(frame->edges, (num_edges + 1) * sizeof(unsigned int));
+        frame->edge_start =
+            realloc(frame->edge_start, (num_edges + 1) * sizeof(size_t));
+        memcpy(frame->edges, edges, num_edges * sizeof(unsigned int));
+
+        size_t start = 0;
+        unsigned int r = 0;
+        for (unsigned int i = 0; i < num_edges; i++) {
+            frame->edge_start[i] = start;
+            memcpy(&frame->edge_values[start],
+                   &probing.values[(size_t)i * probes],
+                   probes * sizeof(int32_t));
+            memcpy(&frame->edge_magnitudes[start],
+                   &probing.magnitudes[(size_t)i * probes],
+                   probes * sizeof(float));
+            start += probes;
+
+            if (r < num_refined && refined[r] == i) {
+                size_t rest = (size_t)r * refining.per_pixel;
+                memcpy(&frame->edge_values[start],
+                       &refining.values[rest],
+                       refining.per_pixel * sizeof(int32_t));
+                memcpy(&frame->edge_magnitudes[start],
+                       &refining.magnitudes[rest],
+                       refining.per_pixel * sizeof(float));
+                start += refining.per_pixel;
+                r++;
+            }
+        }
+        frame->edge_start[num_edges] = start;
+        frame->num_edges = num_edges;
+    }
+
+    free(refining.magnitudes);
+    free(refining.values);
+    free(refined);
+    free(probing.magnitudes);
+    free(probing.values);
+    free(edges);
+    return !cancelled;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "engine.h"
+
+// Neighbouring pixels whose colors differ by more than this, summed over
+// the channels, both lie on an edge. So do samples within a pixel.
+#define ANTIALIAS_CONTRAST 48
+
+// Extra samples every pixel on an edge takes first. Only those where they
+// differ from the pixel take the rest.
+#define ANTIALIAS_PROBES 3
+
+// Finds the pixels of the complete `frame` that lie on an edge, and samples
+// them up to engine_antialias() - 1 more times, at points scattered within
+// them, into the edge samples of `frame`. Returns false, leaving `frame`
+// without edge samples, when cancelled. `stats` may be NULL. Edges are
+// found with the colors of `params`, and frames colored differently later
+// keep them.
+bool antialias_frame(const EngineParams* params,
+                     EngineFrame* frame,
+                     EngineStats* stats);
@@ -0,0 +1,371 @@
+#include "bench.h"
+#include <complex.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+
+#include "bignum.h"
+#include "engine.h"
+#include "kernel.h"
+#include "scheduler.h"
+
+#define BENCH_PI 3.14159265358979323846
+#define BENCH_MAX_LIST 16
+
+#define DEFAULT_BENCH_SIZE 800
+#define DEFAULT_BENCH_FRAMES 3
+
+typedef struct {
+    const char* name;
+    FRACTAL_TYPE fractal_type;
+    double complex center;
+    double complex_width;
+    int max_iter;
+
+    // Decimal center of deep views, past the precision of `center`.
+    const char* deep_re;
+    const char* deep_im;
+
+    double complex julia_c;
+    unsigned int newton_num_roots;
+    unsigned int newton_iterations;
+} BenchView;
+
+static const BenchView bench_views[] = {
+    {
+        .name = "shallow",
+        .fractal_type = FRACTAL_MANDELBROT,
+        .center = -0.5,
+        .complex_width = 3,
+        .max_iter = 256,
+    },
+    {
+        .name = "boundary",
+        .fractal_type = FRACTAL_MANDELBROT,
+        .center = -0.745 + 0.113 * I,
+        .complex_width = 0.01,
+        .max_iter = 1000,
+    },
+    {
+        .name = "deep",
+        .fractal_type = FRACTAL_MANDELBROT,
+        .center = -0.743643887037151 + 0.131825904205330 * I,
+        .complex_width = 1e-11,
+        .max_iter = 2000,
+    },
+    {
+        .name = "spiral",
+        .fractal_type = FRACTAL_MANDELBROT,
+        .center = I,
+        .complex_width = 1e-60,
+        .max_iter = 2000,
+        // A Misiurewicz point, with spirals at every scale.
+        .deep_re = "0",
+        .deep_im = "1",
+    },
+    {
+        .name = "julia",
+        .fractal_type = FRACTAL_JULIA,
+        .center = 0,
+        .complex_width = 3,
+        .max_iter = 512,
+        .julia_c = -0.8 + 0.156 * I,
+    },
+    {
+        .name = "newton",
+        .fractal_type = FRACTAL_NEWTON,
+        .center = 0,
+        .complex_width = 3,
+        .newton_num_roots = 12,
+        .newton_iterations = 20,
+    },
+    {
+        .name = "polynomial",
+        .fractal_type = FRACTAL_NEWTON,
+        .center = 0,
+        .complex_width = 3,
+        .newton_num_roots = 256,
+        .newton_iterations = 50,
+    },
+};
+
+#define BENCH_NUM_VIEWS (sizeof(bench_views) / sizeof(bench_views[0]))
+
+static int parse_list(char* arg, int* values) {
+    int count = 0;
+    for (char* token = strtok(arg, ","); token != NULL;
+         token = strtok(NULL, ",")) {
+        if (count == BENCH_MAX_LIST)
+            return -1;
+        int value = atoi(token);
+        if (value <= 0)
+            return -1;
+        values[count++] = value;
+    }
+    return count;
+}
+
+static int parse_kernels(char* arg, KERNEL_TYPE* kernels) {
+    int count = 0;
+    for (char* name = strtok(arg, ","); name != NULL;
+         name = strtok(NULL, ",")) {
+        int kernel = kernel_from_name(name);
+        if (count == KERNEL_NUM_TYPES || kernel < 0)
+            return -1;
+        if (!kernel_supported(kernel)) {
+            fprintf(stderr, "This CPU does not support the %s kernel\n", name);
+            return -1;
+        }
+        kernels[count++] = kernel;
+    }
+    return count;
+}
+
+static int parse_precisions(char* arg, PRECISION_TYPE* precisions) {
+    int count = 0;
+    for (char* name = strtok(arg, ","); name != NULL;
+         name = strtok(NULL, ",")) {
+        int precision = engine_precision_from_name(name);
+        if (count == PRECISION_NUM_TYPES || precision < 0)
+            return -1;
+        precisions[count++] = precision;
+    }
+    return count;
+}
+
+static const BenchView* find_view(const char* name) {
+    for (unsigned int i = 0; i < BENCH_NUM_VIEWS; i++) {
+        if (strcmp(bench_views[i].name, name) == 0)
+            return &bench_views[i];
+    }
+    return NULL;
+}
+
+static void print_usage(void) {
+    fprintf(stderr,
+            "Usage: main.out --bench [--sizes N,...] [--threads N,...] "
+            "[--frames N] [--views NAME,...] [--kernels NAME,...] "
+            "[--precisions NAME,...] [--subdivide] [--antialias N] "
+            "[--per-thread]\n"
+            "Views:");
+    for (unsigned int i = 0; i < BENCH_NUM_VIEWS; i++) {
+        fprintf(stderr, " %s", bench_views[i].name);
+    }
+    fprintf(stderr, "\nKernels:");
+    for (int kernel = 0; kernel < KERNEL_NUM_TYPES; kernel++) {
+        if (kernel_supported(kernel))
+            fprintf(stderr, " %s", kernel_name(kernel));
+    }
+    fprintf(stderr, "\nPrecisions:");
+    for (int precision = 0; precision < PRECISION_NUM_TYPES; precision++) {
+        fprintf(stderr, " %s", engine_precision_name(precision));
+    }
+    fprintf(stderr, "\n");
+}
+
+static void bench_view(const BenchView* view,
+                       int size,
+                       int threads,
+                       int frames,
+                       KERNEL_TYPE kernel,
+                       PRECISION_TYPE precision,
+                       bool subdivide,
+                       unsigned int antialias,
+                       bool per_thread) {
+    double complex* roots = NULL;
+    if (view->fractal_type == FRACTAL_NEWTON) {
+        roots = malloc(view->newton_num_roots * sizeof(double complex));
+        for (unsigned int i = 0; i < view->newton_num_roots; i++) {
+            roots[i] = cexp(2 * BENCH_PI * I * i / view->newton_num_roots);
+        }
+    }
+
+    EngineParams params = {
+        .fractal_type = view->fractal_type,
+        .width = size,
+        .height = size,
+        .center = view->center,
+        .complex_width = view->complex_width,
+        .max_iter = view->max_iter,
+        .julia_c = view->julia_c,
+        .newton_roots = roots,
+        .newton_num_roots = view->newton_num_roots,
+        .newton_iterations = view->newton_iterations,
+        .kernel = kernel == KERNEL_AUTO ? kernel_best() : kernel,
+        .precision = precision,
+        .subdivide = subdivide,
+        .antialias = antialias,
+        .deep_center = bigcomplex_from_complex(view->center),
+    };
+    if (view->deep_re != NULL) {
+        bignum_from_string(view->deep_re, &params.deep_center.re);
+        bignum_from_string(view->deep_im, &params.deep_center.im);
+    }
+
+    uint32_t* pixels = malloc((size_t)size * size * sizeof(uint32_t));
+
+    omp_set_num_threads(threads);
+
+    // Warm up the thread pool and the caches before timing anything.
+    engine_render(&params, pixels, NULL);
+
+    double total_time = 0;
+    double best_time = INFINITY;
+    double total_iterations = 0;
+    SchedulerStats threads_total = {0};
+    for (int frame = 0; frame < frames; frame++) {
+        EngineStats stats;
+        double start = omp_get_wtime();
+        engine_render(&params, pixels, &stats);
+        double elapsed = omp_get_wtime() - start;
+
+        total_time += elapsed;
+        total_iterations += stats.iterations;
+        threads_total.num_threads = stats.threads.num_threads;
+        for (unsigned int t = 0; t < stats.threads.num_threads; t++) {
+            threads_total.busy[t] += stats.threads.busy[t];
+            threads_total.tasks[t] += stats.threads.tasks[t];
+            threads_total.steals[t] += stats.threads.steals[t];
+        }
+        if (elapsed < best_time)
+            best_time = elapsed;
+    }
+
+    double pixels_per_frame = (double)size * size;
+    printf("%-10s %6d %8d %8s %9s %10.2f %10.2f %10.2f %10.2f %8.2f\n",
+           view->name,
+           size,
+           threads,
+           kernel_name(params.kernel),
+           engine_precision_name(engine_precision(&params)),
+           total_time * 1e3 / frames,
+           best_time * 1e3,
+           pixels_per_frame * frames / total_time / 1e6,
+           total_iterations / total_time / 1e6,
+           scheduler_imbalance(&threads_total));
+
+    if (per_thread) {
+        for (unsigned int t = 0; t < threads_total.num_threads; t++) {
+            printf("    thread %3u %10.2f ms/frame %6u tiles %6u stolen\n",
+                   t,
+                   threads_total.busy[t] * 1e3 / frames,
+                   threads_total.tasks[t] / frames,
+                   threads_total.steals[t] / frames);
+        }
+    }
+    fflush(stdout);
+
+    free(pixels);
+    free(roots);
+}
+
+int bench_main(int argc, char* argv[]) {
+    int sizes[BENCH_MAX_LIST] = {DEFAULT_BENCH_SIZE};
+    int num_sizes = 1;
+    int threads[BENCH_MAX_LIST] = {omp_get_max_threads()};
+    int num_threads = 1;
+    int frames = DEFAULT_BENCH_FRAMES;
+    KERNEL_TYPE kernels[KERNEL_NUM_TYPES] = {KERNEL_AUTO};
+    int num_kernels = 1;
+    PRECISION_TYPE precisions[PRECISION_NUM_TYPES] = {PRECISION_AUTO};
+    int num_precisions = 1;
+    bool subdivide = false;
+    int antialias = 1;
+    bool per_thread = false;
+    const BenchView* views[BENCH_NUM_VIEWS];
+    int num_views = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--subdivide") == 0) {
+            subdivide = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--per-thread") == 0) {
+            per_thread = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            print_usage();
+            return 1;
+        }
+
+        char* value = argv[++i];
+        if (strcmp(argv[i - 1], "--sizes") == 0) {
+            num_sizes = parse_list(value, sizes);
+        } else if (strcmp(argv[i - 1], "--threads") == 0) {
+            num_threads = parse_list(value, threads);
+        } else if (strcmp(argv[i - 1], "--frames") == 0) {
+            frames = atoi(value);
+        } else if (strcmp(argv[i - 1], "--antialias") == 0) {
+            antialias = atoi(value);
+        } else if (strcmp(argv[i - 1], "--kernels") == 0) {
+            num_kernels = parse_kernels(value, kernels);
+        } else if (strcmp(argv[i - 1], "--precisions") == 0) {
+            num_precisions = parse_precisions(value, precisions);
+        } else if (strcmp(argv[i - 1], "--views") == 0) {
+            for (char* name = strtok(value, ","); name != NULL;
+                 name = strtok(NULL, ",")) {
+                const BenchView* view = find_view(name);
+                if (view == NULL || num_views == BENCH_NUM_VIEWS) {
+                    print_usage();
+                    return 1;
+                }
+                views[num_views++] = view;
+            }
+        } else {
+            print_usage();
+            return 1;
+        }
+
+        if (num_sizes <= 0 || num_threads <= 0 || frames <= 0 ||
+            num_kernels <= 0 || num_precisions <= 0 || antialias <= 0) {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (num_views == 0) {
+        for (unsigned int i = 0; i < BENCH_NUM_VIEWS; i++) {
+            views[num_views++] = &bench_views[i];
+        }
+    }
+
+    printf("%-10s %6s %8s %8s %9s %10s %10s %10s %10s %8s\n",
+           "view",
+           "size",
+           "threads",
+           "kernel",
+           "precision",
+           "ms/frame",
+           "best ms",
+           "Mpixel/s",
+           "Miter/s",
+           "imbal");
+
+    for (int v = 0; v < num_views; v++) {
+        for (int s = 0; s < num_sizes; s++) {
+            for (int t = 0; t < num_threads; t++) {
+                for (int k = 0; k < num_kernels; k++) {
+                    for (int p = 0; p < num_precisions; p++) {
+                        bench_view(views[v],
+                                   sizes[s],
+                                   threads[t],
+                                   frames,
+                                   kernels[k],
+                                   precisions[p],
+                                   subdivide,
+                                   antialias,
+                                   per_thread);
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
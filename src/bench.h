@@ -0,0 +1,5 @@
+#pragma once
+
+// Headless entry point for `main.out --bench`. Renders a fixed set of
+// canonical views and prints throughput numbers, without initializing GTK.
+int bench_main(int argc, char* argv[]);
@@ -0,0 +1,206 @@
+#include "bignum.h"
+#include <complex.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+static int compare_magnitudes(const uint32_t* a, const uint32_t* b) {
+    for (int i = BIGNUM_LIMBS - 1; i >= 0; i--) {
+        if (a[i] != b[i])
+            return a[i] > b[i] ? 1 : -1;
+    }
+    return 0;
+}
+
+static void add_magnitudes(const uint32_t* a,
+                           const uint32_t* b,
+                           uint32_t* result) {
+    uint64_t carry = 0;
+    for (int i = 0; i < BIGNUM_LIMBS; i++) {
+        uint64_t sum = (uint64_t)a[i] + b[i] + carry;
+        result[i] = sum;
+        carry = sum >> 32;
+    }
+}
+
+// `a` must be at least `b`.
+static void sub_magnitudes(const uint32_t* a,
+                           const uint32_t* b,
+                           uint32_t* result) {
+    uint64_t borrow = 0;
+    for (int i = 0; i < BIGNUM_LIMBS; i++) {
+        uint64_t difference = (uint64_t)a[i] - b[i] - borrow;
+        result[i] = difference;
+        borrow = (difference >> 32) & 1;
+    }
+}
+
+static bool is_zero(const BigNum* value) {
+    for (int i = 0; i < BIGNUM_LIMBS; i++) {
+        if (value->limbs[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+// Zero is never negative, so that equal numbers have equal representations.
+static BigNum normalize(BigNum value) {
+    if (value.negative && is_zero(&value))
+        value.negative = false;
+    return value;
+}
+
+BigNum bignum_from_double(double value) {
+    BigNum result = {.negative = value < 0};
+    double remainder = fabs(value);
+
+    for (int i = BIGNUM_LIMBS - 1; i >= 0; i--) {
+        double limb = floor(remainder);
+        result.limbs[i] = limb;
+        remainder = (remainder - limb) * 0x1p32;
+    }
+
+    return normalize(result);
+}
+
+double bignum_to_double(const BigNum* value) {
+    double result = 0;
+    for (int i = 0; i < BIGNUM_LIMBS; i++) {
+        result = result * 0x1p-32 + value->limbs[i];
+    }
+    return value->negative ? -result : result;
+}
+
+bool bignum_from_string(const char* string, BigNum* value) {
+    BigNum result = {0};
+    const char* digit = string;
+
+    if (*digit == '-' || *digit == '+') {
+        result.negative = *digit == '-';
+        digit++;
+    }
+
+    uint64_t integer = 0;
+    const char* integer_start = digit;
+    while (isdigit((unsigned char)*digit)) {
+        integer = integer * 10 + (*digit - '0');
+        if (integer > UINT32_MAX)
+            return false;
+        digit++;
+    }
+    bool has_digits = digit != integer_start;
+
+    if (*digit == '.') {
+        const char* fraction_start = ++digit;
+        while (isdigit((unsigned char)*digit)) {
+            digit++;
+        }
+        has_digits = has_digits || digit != fraction_start;
+
+        // Horner's scheme from the last digit: fraction = (d + fraction) / 10
+        for (const char* d = digit - 1; d >= fraction_start; d--) {
+            result.limbs[BIGNUM_LIMBS - 1] = *d - '0';
+
+            uint64_t remainder = 0;
+            for (int i = BIGNUM_LIMBS - 1; i >= 0; i--) {
+                uint64_t current = remainder << 32 | result.limbs[i];
+                result.limbs[i] = current / 10;
+                remainder = current % 10;
+            }
+        }
+    }
+
+    if (*digit != '\0' || !has_digits)
+        return false;
+
+    result.limbs[BIGNUM_LIMBS - 1] = integer;
+    *value = normalize(result);
+    return true;
+}
+
+BigNum bignum_add(const BigNum* a, const BigNum* b) {
+    BigNum result;
+
+    if (a->negative == b->negative) {
+        result.negative = a->negative;
+        add_magnitudes(a->limbs, b->limbs, result.limbs);
+    } else if (compare_magnitudes(a->limbs, b->limbs) >= 0) {
+        result.negative = a->negative;
+        sub_magnitudes(a->limbs, b->limbs, result.limbs);
+    } else {
+        result.negative = b->negative;
+        sub_magnitudes(b->limbs, a->limbs, result.limbs);
+    }
+
+    return normalize(result);
+}
+
+BigNum bignum_sub(const BigNum* a, const BigNum* b) {
+    BigNum negated = *b;
+    negated.negative = !negated.negative;
+    return bignum_add(a, &negated);
+}
+
+BigNum bignum_mul(const BigNum* a, const BigNum* b) {
+    uint32_t product[2 * BIGNUM_LIMBS] = {0};
+
+    for (int i = 0; i < BIGNUM_LIMBS; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < BIGNUM_LIMBS; j++) {
+            uint64_t term =
+                (uint64_t)a->limbs[i] * b->limbs[j] + product[i + j] + carry;
+            product[i + j] = term;
+            carry = term >> 32;
+        }
+        product[i + BIGNUM_LIMBS] = carry;
+    }
+
+    // The product has twice the fractional limbs; drop the lowest ones.
+    BigNum result = {.negative = a->negative != b->negative};
+    memcpy(result.limbs,
+           &product[BIGNUM_LIMBS - 1],
+           BIGNUM_LIMBS * sizeof(uint32_t));
+
+    return normalize(result);
+}
+
+bool bignum_equal(const BigNum* a, const BigNum* b) {
+    return a->negative == b->negative &&
+           compare_magnitudes(a->limbs, b->limbs) == 0;
+}
+
+BigComplex bigcomplex_from_complex(double complex value) {
+    return (BigComplex){
+        .re = bignum_from_double(creal(value)),
+        .im = bignum_from_double(cimag(value)),
+    };
+}
+
+double complex bigcomplex_to_complex(const BigComplex* value) {
+    return bignum_to_double(&value->re) + bignum_to_double(&value->im) * I;
+}
+
+BigComplex bigcomplex_add(const BigComplex* a, const BigComplex* b) {
+    return (BigComplex){
+        .re = bignum_add(&a->re, &b->re),
+        .im = bignum_add(&a->im, &b->im),
+    };
+}
+
+BigComplex bigcomplex_sub(const BigComplex* a, const BigComplex* b) {
+    return (BigComplex){
+        .re = bignum_sub(&a->re, &b->re),
+        .im = bignum_sub(&a->im, &b->im),
+    };
+}
+
+BigComplex bigcomplex_add_complex(const BigComplex* a, double complex b) {
+    BigComplex offset = bigcomplex_from_complex(b);
+    return bigcomplex_add(a, &offset);
+}
+
+bool bigcomplex_equal(const BigComplex* a, const BigComplex* b) {
+    return bignum_equal(&a->re, &b->re) && bignum_equal(&a->im, &b->im);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <complex.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// 32 integer bits and 480 fractional bits, enough to resolve pixels of views
+// down to widths around 1e-140.
+#define BIGNUM_LIMBS 16
+
+// Signed fixed point number. limbs[BIGNUM_LIMBS - 1] holds the integer part
+// and each lower limb the next 32 bits of the fraction.
+typedef struct {
+    bool negative;
+    uint32_t limbs[BIGNUM_LIMBS];
+} BigNum;
+
+typedef struct {
+    BigNum re;
+    BigNum im;
+} BigComplex;
+
+BigNum bignum_from_double(double value);
+
+double bignum_to_double(const BigNum* value);
+
+// Parses a decimal number such as "-0.7436438870371587". Returns false if
+// `string` isn't one.
+bool bignum_from_string(const char* string, BigNum* value);
+
+BigNum bignum_add(const BigNum* a, const BigNum* b);
+
+BigNum bignum_sub(const BigNum* a, const BigNum* b);
+
+BigNum bignum_mul(const BigNum* a, const BigNum* b);
+
+bool bignum_equal(const BigNum* a, const BigNum* b);
+
+BigComplex bigcomplex_from_complex(double complex value);
+
+double complex bigcomplex_to_complex(const BigComplex* value);
+
+BigComplex bigcomplex_add(const BigComplex* a, const BigComplex* b);
+
+BigComplex bigcomplex_sub(const BigComplex* a, const BigComplex* b);
+
+// Moves `a` by a double precision offset, as pans do.
+BigComplex bigcomplex_add_complex(const BigComplex* a, double complex b);
+
+bool bigcomplex_equal(const BigComplex* a, const BigComplex* b);
@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cluster.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+typedef struct {
+    char* address;
+
+    // -1 once the worker failed, which leaves it out of later frames.
+    int socket;
+} Worker;
+
+struct Cluster {
+    Worker* workers;
+    unsigned int num_workers;
+};
+
+// Tiles of the frame being rendered, shared by the threads feeding the
+// workers.
+typedef struct {
+    const EngineParams* params;
+    EngineFrame* frame;
+    unsigned int tile_rows;
+    unsigned int num_tiles;
+
+    mtx_t mutex;
+    unsigned int next_tile;
+
+    // Tiles whose worker failed, handed out again before the others.
+    unsigned int* retries;
+    unsigned int num_retries;
+
+    uint64_t iterations;
+} Render;
+
+typedef struct {
+    Render* render;
+    Worker* worker;
+} Feeder;
+
+Cluster* cluster_new(const char* addresses) {
+    Cluster* cluster = calloc(1, sizeof(Cluster));
+    char* list = strdup(addresses);
+    char* rest;
+    for (char* address = strtok_r(list, ",", &rest); address != NULL;
+         address = strtok_r(NULL, ",", &rest)) {
+        int socket = protocol_connect(address);
+        if (socket < 0) {
+            fprintf(stderr, "%s: %s\n", address, strerror(errno));
+            continue;
+        }
+
+        cluster->workers = realloc(cluster->workers,
+                                   (cluster->num_workers + 1) * sizeof(Worker));
+        cluster->workers[cluster->num_workers++] = (Worker){
+            .address = strdup(address),
+            .socket = socket,
+        };
+    }
+    free(list);
+
+    if (cluster->num_workers == 0) {
+        cluster_free(cluster);
+        return NULL;
+    }
+    return cluster;
+}
+
+static bool take_tile(Render* render, unsigned int* tile) {
+    mtx_lock(&render->mutex);
+    bool taken = true;
+    if (render->num_retries > 0) {
+        *tile = render->retries[--render->num_retries];
+    } else if (render->next_tile < render->num_tiles) {
+        *tile = render->next_tile++;
+    } else {
+        taken = false;
+    }
+    mtx_unlock(&render->mutex);
+    return taken;
+}
+
+static unsigned int tile_rows(const Render* render, unsigned int tile) {
+    unsigned int top = tile * render->tile_rows;
+    return render->params->height - top < render->tile_rows
+               ? render->params->height - top
+               : render->tile_rows;
+}
+
+// Sends the worker one tile at a time, until there are none left or it
+// fails.
+static int feed_worker(void* data) {
+    Feeder* feeder = data;
+    Render* render = feeder->render;
+    Worker* worker = feeder->worker;
+    Message message = {0};
+
+    unsigned int tile;
+    while (take_tile(render, &tile)) {
+        ProtocolJob job = {
+            .id = tile,
+            .top = tile * render->tile_rows,
+            .rows = tile_rows(render, tile),
+            .params = *render->params,
+        };
+        protocol_put_job(&message, &job);
+
+        uint64_t iterations;
+        if (!protocol_send(worker->socket, &message) ||
+            !protocol_receive(worker->socket, &message) ||
+            !protocol_get_tile(&message,
+                               job.id,
+                               render->frame,
+                               job.top,
+                               job.rows,
+                               &iterations)) {
+            fprintf(stderr,
+                    "Worker %s failed, its tiles go to the others\n",
+                    worker->address);
+            close(worker->socket);
+            worker->socket = -1;
+
+            mtx_lock(&render->mutex);
+            render->retries[render->num_retries++] = tile;
+            mtx_unlock(&render->mutex);
+            break;
+        }
+
+        mtx_lock(&render->mutex);
+        render->iterations += iterations;
+        mtx_unlock(&render->mutex);
+    }
+
+    message_free(&message);
+    return 0;
+}
+
+void cluster_render(Cluster* cluster,
+                    const EngineParams* params,
+                    EngineFrame* frame,
+                    EngineStats* stats) {
+    Render render = {
+        .params = params,
+        .frame = frame,
+        .tile_rows = CLUSTER_TILE_PIXELS / params->width /
+                     ENGINE_MAX_TILE_SIZE * ENGINE_MAX_TILE_SIZE,
+    };
+    if (render.tile_rows == 0)
+        render.tile_rows = ENGINE_MAX_TILE_SIZE;
+    render.num_tiles =
+        (params->height + render.tile_rows - 1) / render.tile_rows;
+    render.retries = malloc(render.num_tiles * sizeof(unsigned int));
+    mtx_init(&render.mutex, mtx_plain);
+
+    thrd_t* threads = malloc(cluster->num_workers * sizeof(thrd_t));
+    Feeder* feeders = malloc(cluster->num_workers * sizeof(Feeder));
+    unsigned int num_threads = 0;
+    for (unsigned int i = 0; i < cluster->num_workers; i++) {
+        if (cluster->workers[i].socket < 0)
+            continue;
+
+        feeders[num_threads] = (Feeder){&render, &cluster->workers[i]};
+        if (thrd_create(&threads[num_threads],
+                        feed_worker,
+                        &feeders[num_threads]) == thrd_success)
+            num_threads++;
+    }
+    for (unsigned int i = 0; i < num_threads; i++) {
+        thrd_join(threads[i], NULL);
+    }
+    free(feeders);
+    free(threads);
+
+    // Whatever the workers couldn't take renders here.
+    unsigned int tile;
+    while (take_tile(&render, &tile)) {
+        EngineStats tile_stats = {0};
+        engine_render_region_pass(params,
+                                  frame,
+                                  0,
+                                  tile * render.tile_rows,
+                                  params->width,
+                                  tile_rows(&render, tile),
+                                  1,
+                                  false,
+                                  &tile_stats);
+        render.iterations += tile_stats.iterations;
+    }
+
+    mtx_destroy(&render.mutex);
+    free(render.retries);
+
+    if (stats != NULL)
+        stats->iterations = render.iterations;
+}
+
+void cluster_free(Cluster* cluster) {
+    for (unsigned int i = 0; i < cluster->num_workers; i++) {
+        if (cluster->workers[i].socket >= 0)
+            close(cluster->workers[i].socket);
+        free(cluster->workers[i].address);
+    }
+    free(cluster->workers);
+    free(cluster);
+}
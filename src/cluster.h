@@ -0,0 +1,28 @@
+#pragma once
+
+#include "engine.h"
+
+// Tiles handed out to workers hold about this many pixels, in whole rows of
+// engine tiles.
+#define CLUSTER_TILE_PIXELS (1 << 18)
+
+// Worker processes, reached over sockets, that render frames for the
+// coordinator a tile at a time, see worker_main().
+typedef struct Cluster Cluster;
+
+// Connects to the comma-separated worker `addresses`, see
+// protocol_connect(). Workers that can't be reached are reported and left
+// out. Returns NULL when none can.
+Cluster* cluster_new(const char* addresses);
+
+// Renders the whole frame of `params` at full resolution, as
+// engine_render_pass() does with a block of 1, with idle workers taking the
+// next tile. Tiles of workers that fail go to the others, and those left
+// once every worker failed render here. `stats` may be NULL, and only
+// counts iterations.
+void cluster_render(Cluster* cluster,
+                    const EngineParams* params,
+                    EngineFrame* frame,
+                    EngineStats* stats);
+
+void cluster_free(Cluster* cluster);
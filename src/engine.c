@@ -0,0 +1,1039 @@
+#include "engine.h"
+#include <complex.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+
+#include "antialias.h"
+#include "bignum.h"
+#include "kernel.h"
+#include "newton.h"
+#include "perturbation.h"
+#include "scheduler.h"
+
+static const char* precision_names[PRECISION_NUM_TYPES] = {
+    [PRECISION_AUTO] = "auto",
+    [PRECISION_FLOAT] = "float",
+    [PRECISION_DOUBLE] = "double",
+    [PRECISION_DOUBLE_DOUBLE] = "dd",
+    [PRECISION_BIGNUM] = "bignum",
+};
+
+unsigned int engine_newton_root(const EngineParams* params, int32_t value) {
+    return value % params->newton_num_roots;
+}
+
+unsigned int engine_newton_iteration(const EngineParams* params,
+                                     int32_t value) {
+    return value / params->newton_num_roots;
+}
+
+void engine_sample_points(const EngineParams* params,
+                          const double* re,
+                          const double* im,
+                          unsigned int count,
+                          int32_t* values,
+                          float* magnitudes,
+                          uint64_t* iterations) {
+    if (params->fractal_type == FRACTAL_NEWTON) {
+        newton_sample_points(params,
+                             params->newton_index,
+                             re,
+                             im,
+                             count,
+                             values,
+                             magnitudes,
+                             iterations);
+        return;
+    }
+
+    if (engine_is_deep(params)) {
+        perturbation_sample_points(params,
+                                   params->reference,
+                                   re,
+                                   im,
+                                   count,
+                                   values,
+                                   magnitudes,
+                                   iterations);
+        return;
+    }
+
+    if (engine_precision(params) == PRECISION_FLOAT) {
+        kernel_escape_time_float(params->kernel,
+                                 params->fractal_type == FRACTAL_MANDELBROT,
+                                 params->julia_c,
+                                 params->max_iter,
+                                 re,
+                                 im,
+                                 count,
+                                 values,
+                                 magnitudes,
+                                 iterations);
+        return;
+    }
+
+    kernel_escape_time(params->kernel,
+                       params->fractal_type == FRACTAL_MANDELBROT,
+                       params->julia_c,
+                       params->max_iter,
+                       re,
+                       im,
+                       count,
+                       values,
+                       magnitudes,
+                       iterations);
+}
+
+void engine_sample_scanline(const EngineParams* params,
+                            double step,
+                            double grid_x,
+                            double grid_y,
+                            const unsigned int* xs,
+                            unsigned int count,
+                            int32_t* values,
+                            float* magnitudes,
+                            uint64_t* iterations) {
+    double re[ENGINE_BATCH_SIZE], im[ENGINE_BATCH_SIZE];
+    double row_im = -(grid_y * step);
+
+    for (unsigned int i = 0; i < count; i++) {
+        re[i] = (grid_x + xs[i]) * step;
+        im[i] = row_im;
+    }
+
+    engine_sample_points(
+        params, re, im, count, values, magnitudes, iterations);
+}
+
+// Working state of engine_subdivide(). Samples are queued up to a full
+// batch, whatever part of the rectangle they come from.
+typedef struct {
+    const EngineParams* params;
+    double step;
+    double grid_x;
+    double grid_y;
+    unsigned int width;
+    int32_t* values;
+    float* magnitudes;
+    bool* known;
+    uint64_t* iterations;
+
+    unsigned int count;
+    unsigned int indices[ENGINE_BATCH_SIZE];
+    double re[ENGINE_BATCH_SIZE];
+    double im[ENGINE_BATCH_SIZE];
+} Subdivision;
+
+static void subdivision_flush(Subdivision* subdivision) {
+    if (subdivision->count == 0)
+        return;
+
+    int32_t values[ENGINE_BATCH_SIZE];
+    float magnitudes[ENGINE_BATCH_SIZE];
+    engine_sample_points(subdivision->params,
+                         subdivision->re,
+                         subdivision->im,
+                         subdivision->count,
+                         values,
+                         magnitudes,
+                         subdivision->iterations);
+
+    for (unsigned int i = 0; i < subdivision->count; i++) {
+        subdivision->values[subdivision->indices[i]] = values[i];
+        subdivision->magnitudes[subdivision->indices[i]] = magnitudes[i];
+    }
+    subdivision->count = 0;
+}
+
+// Queues the pixels of [`left`, `right`] x [`top`, `bottom`] not known yet.
+static void subdivision_sample(Subdivision* subdivision,
+                               unsigned int left,
+                               unsigned int top,
+                               unsigned int right,
+                               unsigned int bottom) {
+    for (unsigned int y = top; y <= bottom; y++) {
+        for (unsigned int x = left; x <= right; x++) {
+            unsigned int index = y * subdivision->width + x;
+            if (subdivision->known[index])
+                continue;
+
+            unsigned int i = subdivision->count++;
+            subdivision->indices[i] = index;
+            subdivision->re[i] = (subdivision->grid_x + x) * subdivision->step;
+            subdivision->im[i] =
+                -((subdivision->grid_y + y) * subdivision->step);
+            subdivision->known[index] = true;
+
+            if (subdivision->count == ENGINE_BATCH_SIZE)
+                subdivision_flush(subdivision);
+        }
+    }
+}
+
+// Fills the rectangle [`left`, `right`] x [`top`, `bottom`], inclusive.
+static void subdivide(Subdivision* subdivision,
+                      unsigned int left,
+                      unsigned int top,
+                      unsigned int right,
+                      unsigned int bottom) {
+    unsigned int width = subdivision->width;
+    int32_t* values = subdivision->values;
+
+    if (right - left < ENGINE_MIN_SUBDIVISION ||
+        bottom - top < ENGINE_MIN_SUBDIVISION) {
+        subdivision_sample(subdivision, left, top, right, bottom);
+        return;
+    }
+
+    subdivision_sample(subdivision, left, top, right, top);
+    subdivision_sample(subdivision, left, bottom, right, bottom);
+    subdivision_sample(subdivision, left, top + 1, left, bottom - 1);
+    subdivision_sample(subdivision, right, top + 1, right, bottom - 1);
+    subdivision_flush(subdivision);
+
+    int32_t value = values[top * width + left];
+    bool uniform = true;
+    for (unsigned int x = left; x <= right && uniform; x++) {
+        uniform = values[top * width + x] == value &&
+                  values[bottom * width + x] == value;
+    }
+    for (unsigned int y = top; y <= bottom && uniform; y++) {
+        uniform = values[y * width + left] == value &&
+                  values[y * width + right] == value;
+    }
+
+    // Only the inside of the set gets filled, where magnitudes are all 0.
+    // Elsewhere, smooth coloring tells apart pixels that share an escape
+    // time by their magnitudes, which only iterating them gives exactly.
+    if (uniform && value < 0 &&
+        subdivision->params->fractal_type != FRACTAL_NEWTON) {
+        for (unsigned int y = top + 1; y < bottom; y++) {
+            for (unsigned int x = left + 1; x < right; x++) {
+                values[y * width + x] = value;
+                subdivision->magnitudes[y * width + x] = 0;
+                subdivision->known[y * width + x] = true;
+            }
+        }
+        return;
+    }
+    if (uniform) {
+        subdivision_sample(
+            subdivision, left + 1, top + 1, right - 1, bottom - 1);
+        return;
+    }
+
+    // Both halves share the line they are split along.
+    if (right - left >= bottom - top) {
+        unsigned int middle = (left + right) / 2;
+        subdivide(subdivision, left, top, middle, bottom);
+        subdivide(subdivision, middle, top, right, bottom);
+    } else {
+        unsigned int middle = (top + bottom) / 2;
+        subdivide(subdivision, left, top, right, middle);
+        subdivide(subdivision, left, middle, right, bottom);
+    }
+}
+
+void engine_subdivide(const EngineParams* params,
+                      double step,
+                      double grid_x,
+                      double grid_y,
+                      unsigned int width,
+                      unsigned int height,
+                      unsigned int known_block,
+                      int32_t* values,
+                      float* magnitudes,
+                      uint64_t* iterations) {
+    bool known[ENGINE_MAX_TILE_SIZE * ENGINE_MAX_TILE_SIZE];
+    for (unsigned int y = 0; y < height; y++) {
+        for (unsigned int x = 0; x < width; x++) {
+            known[y * width + x] = known_block != 0 &&
+                                   x % known_block == 0 &&
+                                   y % known_block == 0;
+        }
+    }
+
+    Subdivision subdivision = {
+        .params = params,
+        .step = step,
+        .grid_x = grid_x,
+        .grid_y = grid_y,
+        .width = width,
+        .values = values,
+        .magnitudes = magnitudes,
+        .known = known,
+        .iterations = iterations,
+    };
+    subdivide(&subdivision, 0, 0, width - 1, height - 1);
+    subdivision_flush(&subdivision);
+}
+
+EngineFrame* engine_frame_new(unsigned int width, unsigned int height) {
+    EngineFrame* frame = malloc(sizeof(EngineFrame));
+    *frame = (EngineFrame){
+        .width = width,
+        .height = height,
+        .values = calloc((size_t)width * height, sizeof(int32_t)),
+        .magnitudes = calloc((size_t)width * height, sizeof(float)),
+    };
+    return frame;
+}
+
+void engine_frame_free(EngineFrame* frame) {
+    free(frame->edge_magnitudes);
+    free(frame->edge_values);
+    free(frame->edge_start);
+    free(frame->edges);
+    free(frame->magnitudes);
+    free(frame->values);
+    free(frame);
+}
+
+// log2(`x`) for positive `x`, within 1e-4, from the exponent of `x` and a
+// polynomial of its mantissa. Unlike log2f(), it vectorizes.
+static inline float fast_log2(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    float exponent = (int32_t)(bits >> 23) - 127;
+
+    bits = (bits & 0x007fffff) | 0x3f800000;
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+
+    float mantissa = 0.44717955f - 0.056570851f * m;
+    mantissa = -1.4699568f + mantissa * m;
+    mantissa = 2.8212026f + mantissa * m;
+    mantissa = -1.7417939f + mantissa * m;
+    return exponent + mantissa;
+}
+
+// Palette entries and brightness of `count` escape-time samples, from their
+// normalized iteration count n + 1 - log2(log2 |z|), which runs continuously
+// across the bands of escape times. Points inside the set are black.
+static void escape_time_shades(const int32_t* values,
+                               const float* magnitudes,
+                               unsigned int count,
+                               float ramp,
+                               uint32_t* entries,
+                               float* shades) {
+    float scale = PALETTE_SIZE / ramp;
+#pragma omp simd
+    for (unsigned int i = 0; i < count; i++) {
+        float smooth = values[i] + 2 - fast_log2(fast_log2(magnitudes[i]));
+        entries[i] = (int32_t)(smooth * scale) & (PALETTE_SIZE - 1);
+        shades[i] = values[i] < 0 ? 0 : 1;
+    }
+}
+
+// Colors of the basins of `num_roots` roots, as opaque 0xAARRGGBB words.
+// Hues go around the color wheel by the golden ratio, so that however many
+// roots there are, neighbours never get close hues.
+static uint32_t* newton_root_colors(unsigned int num_roots) {
+    uint32_t* colors = malloc(num_roots * sizeof(uint32_t));
+    for (unsigned int root = 0; root < num_roots; root++) {
+        double hue = fmod(root * 0.6180339887498949, 1) * 6;
+        unsigned int sector = hue;
+        double t = hue - sector;
+        double rgb[6][3] = {{1, t, 0},
+                            {1 - t, 1, 0},
+                            {0, 1, t},
+                            {0, 1 - t, 1},
+                            {t, 0, 1},
+                            {1, 0, 1 - t}};
+        colors[root] = 0xff000000;
+        for (unsigned int channel = 0; channel < 3; channel++) {
+            double white = 1 - rgb[sector][channel];
+            uint32_t value = 255 * (1 - ENGINE_NEWTON_SATURATION * white);
+            colors[root] |= value << (16 - 8 * channel);
+        }
+    }
+    return colors;
+}
+
+// Same as escape_time_shades() for Newton samples, whose entries are roots,
+// darkened with the steps taken to reach them.
+static void newton_shades(const int32_t* values,
+                          const float* magnitudes,
+                          unsigned int count,
+                          float ramp,
+                          unsigned int num_roots,
+                          uint32_t* entries,
+                          float* shades) {
+    float tolerance_log2 = log2(NEWTON_TOLERANCE * NEWTON_TOLERANCE);
+    int32_t roots = num_roots;
+#pragma omp simd
+    for (unsigned int i = 0; i < count; i++) {
+        // Exact as long as values stay below 2^24, and unlike an integer
+        // division, vectorizes.
+        int32_t iteration = (values[i] + 0.5f) / roots;
+        entries[i] = values[i] - iteration * roots;
+
+        // Digits of the root double every step, so how many more than
+        // NEWTON_TOLERANCE needs a point ended with tells how much of its
+        // last step it didn't need.
+        float gained = fast_log2(magnitudes[i]) / tolerance_log2;
+
+        // Clamped to [1, 2] with fabsf(), as comparisons of floats that may
+        // trap don't vectorize.
+        gained = (gained + 1 + fabsf(gained - 1)) / 2;
+        gained = (gained + 2 - fabsf(gained - 2)) / 2;
+        float overshoot = fast_log2(gained);
+        shades[i] = ramp / (ramp + iteration - overshoot);
+    }
+}
+
+// Palette entries and shades of `count` samples of the fractal of `params`.
+static void sample_shades(const EngineParams* params,
+                          float ramp,
+                          const int32_t* values,
+                          const float* magnitudes,
+                          unsigned int count,
+                          uint32_t* entries,
+                          float* shades) {
+    if (params->fractal_type == FRACTAL_NEWTON) {
+        newton_shades(values,
+                      magnitudes,
+                      count,
+                      ramp,
+                      params->newton_num_roots,
+                      entries,
+                      shades);
+    } else {
+        escape_time_shades(values, magnitudes, count, ramp, entries, shades);
+    }
+}
+
+// Darkens an opaque 0xAARRGGBB `color` by `shade`, between 0 and 1.
+static inline uint32_t shade_color(uint32_t color, float shade) {
+    uint32_t red = ((color >> 16) & 0xff) * shade;
+    uint32_t green = ((color >> 8) & 0xff) * shade;
+    uint32_t blue = (color & 0xff) * shade;
+    return 0xff000000 | red << 16 | green << 8 | blue;
+}
+
+void engine_colorize(const EngineParams* params,
+                     const EngineFrame* frame,
+                     uint32_t* pixels,
+                     unsigned int stride) {
+    float ramp = params->color_ramp != 0 ? params->color_ramp
+                                         : ENGINE_DEFAULT_COLOR_RAMP;
+    bool newton = params->fractal_type == FRACTAL_NEWTON;
+    uint32_t* root_colors =
+        newton ? newton_root_colors(params->newton_num_roots) : NULL;
+    const uint32_t* colors =
+        newton ? root_colors : palette_lut(params->palette);
+
+    // Shades are computed in vectors a batch at a time, and only the colors
+    // are looked up one by one.
+#pragma omp parallel for
+    for (unsigned int y = 0; y < frame->height; y++) {
+        for (unsigned int x = 0; x < frame->width; x += ENGINE_BATCH_SIZE) {
+            size_t start = (size_t)y * frame->width + x;
+            unsigned int count = frame->width - x < ENGINE_BATCH_SIZE
+                                     ? frame->width - x
+                                     : ENGINE_BATCH_SIZE;
+            uint32_t entries[ENGINE_BATCH_SIZE];
+            float shades[ENGINE_BATCH_SIZE];
+            sample_shades(params,
+                          ramp,
+                          &frame->values[start],
+                          &frame->magnitudes[start],
+                          count,
+                          entries,
+                          shades);
+
+            uint32_t* row = &pixels[(size_t)y * stride + x];
+            for (unsigned int i = 0; i < count; i++) {
+                row[i] = shade_color(colors[entries[i]], shades[i]);
+            }
+        }
+    }
+
+    // Edge pixels take the average color of all their samples.
+#pragma omp parallel for
+    for (unsigned int edge = 0; edge < frame->num_edges; edge++) {
+        unsigned int x = frame->edges[edge] % frame->width;
+        unsigned int y = frame->edges[edge] / frame->width;
+        uint32_t* pixel = &pixels[(size_t)y * stride + x];
+        uint32_t red = (*pixel >> 16) & 0xff;
+        uint32_t green = (*pixel >> 8) & 0xff;
+        uint32_t blue = *pixel & 0xff;
+
+        size_t first = frame->edge_start[edge];
+        unsigned int samples = frame->edge_start[edge + 1] - first;
+        for (unsigned int i = 0; i < samples; i += ENGINE_BATCH_SIZE) {
+            unsigned int count = samples - i < ENGINE_BATCH_SIZE
+                                     ? samples - i
+                                     : ENGINE_BATCH_SIZE;
+            uint32_t entries[ENGINE_BATCH_SIZE];
+            float shades[ENGINE_BATCH_SIZE];
+            sample_shades(params,
+                          ramp,
+                          &frame->edge_values[first + i],
+                          &frame->edge_magnitudes[first + i],
+                          count,
+                          entries,
+                          shades);
+
+            for (unsigned int j = 0; j < count; j++) {
+                uint32_t color = shade_color(colors[entries[j]], shades[j]);
+                red += (color >> 16) & 0xff;
+                green += (color >> 8) & 0xff;
+                blue += color & 0xff;
+            }
+        }
+
+        // Rounded to the nearest.
+        uint32_t total = samples + 1;
+        red = (red + total / 2) / total;
+        green = (green + total / 2) / total;
+        blue = (blue + total / 2) / total;
+        *pixel = 0xff000000 | red << 16 | green << 8 | blue;
+    }
+
+    free(root_colors);
+}
+
+void engine_color_samples(const EngineParams* params,
+                          const int32_t* values,
+                          const float* magnitudes,
+                          size_t count,
+                          uint32_t* colors) {
+    float ramp = params->color_ramp != 0 ? params->color_ramp
+                                         : ENGINE_DEFAULT_COLOR_RAMP;
+    bool newton = params->fractal_type == FRACTAL_NEWTON;
+    uint32_t* root_colors =
+        newton ? newton_root_colors(params->newton_num_roots) : NULL;
+    const uint32_t* table = newton ? root_colors : palette_lut(params->palette);
+
+#pragma omp parallel for
+    for (size_t start = 0; start < count; start += ENGINE_BATCH_SIZE) {
+        unsigned int batch = count - start < ENGINE_BATCH_SIZE
+                                 ? count - start
+                                 : ENGINE_BATCH_SIZE;
+        uint32_t entries[ENGINE_BATCH_SIZE];
+        float shades[ENGINE_BATCH_SIZE];
+        sample_shades(params,
+                      ramp,
+                      &values[start],
+                      &magnitudes[start],
+                      batch,
+                      entries,
+                      shades);
+
+        for (unsigned int i = 0; i < batch; i++) {
+            colors[start + i] = shade_color(table[entries[i]], shades[i]);
+        }
+    }
+
+    free(root_colors);
+}
+
+// One pass over a rectangle of the view, with the mapping from pixels to the
+// sample grid resolved once rather than per pixel.
+typedef struct {
+    const EngineParams* params;
+    EngineFrame* frame;
+    double step;
+    double origin_x;
+    double origin_y;
+    unsigned int left;
+    unsigned int top;
+    unsigned int right;
+    unsigned int bottom;
+    unsigned int block;
+    bool refine;
+
+    // The rectangle is split into square tiles, scheduled in `order`.
+    unsigned int tile_size;
+    unsigned int columns;
+    const unsigned int* order;
+} Pass;
+
+// Whether a sample at (x, y) would improve on what the pixels of its block
+// already hold.
+static bool needs_sample(const Pass* pass, unsigned int x, unsigned int y) {
+    const unsigned char* quality = pass->params->quality;
+    unsigned int width = pass->params->width;
+    if (quality[y * width + x] == ENGINE_QUALITY_EXACT)
+        return false;
+
+    for (unsigned int by = y; by < y + pass->block && by < pass->bottom;
+         by++) {
+        for (unsigned int bx = x; bx < x + pass->block && bx < pass->right;
+             bx++) {
+            if (quality[by * width + bx] > pass->block)
+                return true;
+        }
+    }
+    return false;
+}
+
+// Samples the pixels (`xs[i]`, `y`) of a row in one batch, then fills their
+// blocks one contiguous pixel row at a time.
+static void sample_row(const Pass* pass,
+                       const unsigned int* xs,
+                       unsigned int count,
+                       unsigned int y,
+                       uint64_t* iterations) {
+    const EngineParams* params = pass->params;
+    int32_t values[ENGINE_BATCH_SIZE];
+    float magnitudes[ENGINE_BATCH_SIZE];
+
+    engine_sample_scanline(params,
+                           pass->step,
+                           pass->origin_x,
+                           pass->origin_y + y,
+                           xs,
+                           count,
+                           values,
+                           magnitudes,
+                           iterations);
+
+    for (unsigned int by = y; by < y + pass->block && by < pass->bottom;
+         by++) {
+        int32_t* row = &pass->frame->values[by * params->width];
+        float* row_magnitudes = &pass->frame->magnitudes[by * params->width];
+        unsigned char* row_quality = params->quality == NULL
+                                         ? NULL
+                                         : &params->quality[by * params->width];
+
+        for (unsigned int i = 0; i < count; i++) {
+            for (unsigned int bx = xs[i];
+                 bx < xs[i] + pass->block && bx < pass->right;
+                 bx++) {
+                if (row_quality != NULL) {
+                    if (bx == xs[i] && by == y) {
+                        row_quality[bx] = ENGINE_QUALITY_EXACT;
+                    } else if (pass->block < row_quality[bx]) {
+                        row_quality[bx] = pass->block;
+                    } else {
+                        continue;
+                    }
+                }
+
+                row[bx] = values[i];
+                row_magnitudes[bx] = magnitudes[i];
+            }
+        }
+    }
+}
+
+bool engine_cancelled(const EngineParams* params) {
+    return params->cancel != NULL &&
+           atomic_load_explicit(params->cancel, memory_order_relaxed);
+}
+
+double engine_step(const EngineParams* params) {
+    return params->complex_width / params->width;
+}
+
+unsigned int engine_antialias(const EngineParams* params) {
+    if (params->antialias < 1)
+        return 1;
+    if (params->antialias > ENGINE_MAX_ANTIALIAS)
+        return ENGINE_MAX_ANTIALIAS;
+    return params->antialias;
+}
+
+PRECISION_TYPE engine_precision(const EngineParams* params) {
+    if (params->fractal_type == FRACTAL_NEWTON)
+        return PRECISION_DOUBLE;
+    if (params->precision != PRECISION_AUTO)
+        return params->precision;
+
+    // Pixel spacing relative to the largest coordinates of the view.
+    double spacing = engine_step(params) /
+                     (cabs(params->center) + params->complex_width);
+
+    if (spacing > ENGINE_DOUBLE_THRESHOLD)
+        return PRECISION_DOUBLE;
+    if (spacing > ENGINE_DOUBLE_DOUBLE_THRESHOLD)
+        return PRECISION_DOUBLE_DOUBLE;
+    return PRECISION_BIGNUM;
+}
+
+const char* engine_precision_name(PRECISION_TYPE precision) {
+    return precision_names[precision];
+}
+
+int engine_precision_from_name(const char* name) {
+    for (int precision = 0; precision < PRECISION_NUM_TYPES; precision++) {
+        if (strcmp(precision_names[precision], name) == 0)
+            return precision;
+    }
+    return -1;
+}
+
+bool engine_is_deep(const EngineParams* params) {
+    return engine_precision(params) >= PRECISION_DOUBLE_DOUBLE;
+}
+
+unsigned int engine_full_height(const EngineParams* params) {
+    return params->full_height != 0 ? params->full_height : params->height;
+}
+
+void engine_view_origin(const EngineParams* params,
+                        double* grid_x,
+                        double* grid_y) {
+    unsigned int height = engine_full_height(params);
+    if (engine_is_deep(params)) {
+        *grid_x = -(double)(params->width / 2);
+        *grid_y = -(double)(height / 2) + params->band_top;
+        return;
+    }
+
+    double step = engine_step(params);
+    double left = creal(params->center) - params->complex_width / 2;
+    double top = cimag(params->center) + step * height / 2;
+
+    *grid_x = round(left / step);
+    *grid_y = round(-top / step) + params->band_top;
+}
+
+// Whether `a` and `b` render the same fractal, regardless of the view.
+// `same_iterations` tells whether their samples are interchangeable, which
+// takes the same iteration limits and number format.
+static bool same_fractal(const EngineParams* a,
+                         const EngineParams* b,
+                         bool* same_iterations) {
+    if (a->fractal_type != b->fractal_type)
+        return false;
+
+    switch (a->fractal_type) {
+        case FRACTAL_JULIA:
+            if (a->julia_c != b->julia_c)
+                return false;
+            // fallthrough
+        case FRACTAL_MANDELBROT:
+            *same_iterations =
+                a->max_iter == b->max_iter &&
+                engine_precision(a) == engine_precision(b);
+            return true;
+        case FRACTAL_NEWTON:
+            if (a->newton_num_roots != b->newton_num_roots ||
+                memcmp(a->newton_roots,
+                       b->newton_roots,
+                       a->newton_num_roots * sizeof(double complex)) != 0)
+                return false;
+            *same_iterations = a->newton_iterations == b->newton_iterations;
+            return true;
+    }
+
+    return false;
+}
+
+bool engine_same_samples(const EngineParams* a, const EngineParams* b) {
+    bool same_iterations;
+    if (!same_fractal(a, b, &same_iterations) || !same_iterations)
+        return false;
+
+    if (a->width != b->width || a->height != b->height ||
+        a->band_top != b->band_top ||
+        engine_full_height(a) != engine_full_height(b) ||
+        a->complex_width != b->complex_width || a->kernel != b->kernel ||
+        a->subdivide != b->subdivide ||
+        engine_antialias(a) != engine_antialias(b) ||
+        engine_precision(a) != engine_precision(b))
+        return false;
+
+    return engine_is_deep(a) ? bigcomplex_equal(&a->deep_center,
+                                                &b->deep_center)
+                             : a->center == b->center;
+}
+
+bool engine_same_frame(const EngineParams* a, const EngineParams* b) {
+    return engine_same_samples(a, b) && a->palette == b->palette &&
+           a->color_ramp == b->color_ramp;
+}
+
+bool engine_reproject(const EngineParams* from,
+                      const EngineFrame* from_frame,
+                      const unsigned char* from_quality,
+                      const EngineParams* to,
+                      EngineFrame* frame,
+                      unsigned char* quality) {
+    bool same_iterations;
+    if (!same_fractal(from, to, &same_iterations))
+        return false;
+
+    double from_x, from_y, to_x, to_y;
+    engine_view_origin(from, &from_x, &from_y);
+    engine_view_origin(to, &to_x, &to_y);
+
+    // Deep grids are anchored at their own center, so `to` is placed
+    // relative to the anchor of `from`.
+    BigComplex from_anchor = engine_is_deep(from) ? from->deep_center
+                                                  : bigcomplex_from_complex(0);
+    BigComplex to_anchor = engine_is_deep(to) ? to->deep_center
+                                              : bigcomplex_from_complex(0);
+    BigComplex anchor_distance = bigcomplex_sub(&to_anchor, &from_anchor);
+    double complex anchor = bigcomplex_to_complex(&anchor_distance);
+
+    double from_step = engine_step(from);
+    double to_step = engine_step(to);
+
+    // Edge samples fall in between pixels, and don't carry over.
+    frame->num_edges = 0;
+
+#pragma omp parallel for
+    for (unsigned int y = 0; y < to->height; y++) {
+        double source_y =
+            ((to_y + y) * to_step - cimag(anchor)) / from_step - from_y;
+        double nearest_y = round(source_y);
+        bool aligned_y = fabs(source_y - nearest_y) < 1e-6;
+
+        for (unsigned int x = 0; x < to->width; x++) {
+            unsigned int index = y * to->width + x;
+            double source_x =
+                ((to_x + x) * to_step + creal(anchor)) / from_step - from_x;
+            double nearest_x = round(source_x);
+
+            if (nearest_x < 0 || nearest_x >= from->width || nearest_y < 0 ||
+                nearest_y >= from->height) {
+                quality[index] = ENGINE_QUALITY_MISSING;
+                continue;
+            }
+
+            unsigned int source = (unsigned int)nearest_y * from->width +
+                                  (unsigned int)nearest_x;
+            frame->values[index] = from_frame->values[source];
+            frame->magnitudes[index] = from_frame->magnitudes[source];
+
+            unsigned char source_quality = from_quality[source];
+            if (source_quality == ENGINE_QUALITY_EXACT && same_iterations &&
+                aligned_y && fabs(source_x - nearest_x) < 1e-6) {
+                quality[index] = ENGINE_QUALITY_EXACT;
+            } else if (source_quality == ENGINE_QUALITY_MISSING) {
+                quality[index] = ENGINE_QUALITY_MISSING;
+            } else {
+                // Magnified samples cover larger blocks, and a resampled
+                // pixel is never exact.
+                double block = round(source_quality * from_step / to_step);
+                if (block < 2)
+                    block = 2;
+                if (block > ENGINE_QUALITY_MISSING)
+                    block = ENGINE_QUALITY_MISSING;
+                quality[index] = block;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Full resolution pass over a tile through engine_subdivide().
+static uint64_t subdivide_tile(const Pass* pass,
+                               unsigned int left,
+                               unsigned int top,
+                               unsigned int right,
+                               unsigned int bottom) {
+    const EngineParams* params = pass->params;
+    unsigned int width = right - left;
+    unsigned int height = bottom - top;
+
+    if (params->quality != NULL) {
+        bool exact = true;
+        for (unsigned int y = top; y < bottom && exact; y++) {
+            for (unsigned int x = left; x < right && exact; x++) {
+                exact = params->quality[y * params->width + x] ==
+                        ENGINE_QUALITY_EXACT;
+            }
+        }
+        if (exact)
+            return 0;
+    }
+
+    int32_t values[ENGINE_MAX_TILE_SIZE * ENGINE_MAX_TILE_SIZE];
+    float magnitudes[ENGINE_MAX_TILE_SIZE * ENGINE_MAX_TILE_SIZE];
+    uint64_t iterations = 0;
+    engine_subdivide(params,
+                     pass->step,
+                     pass->origin_x + left,
+                     pass->origin_y + top,
+                     width,
+                     height,
+                     0,
+                     values,
+                     magnitudes,
+                     &iterations);
+
+    for (unsigned int y = 0; y < height; y++) {
+        for (unsigned int x = 0; x < width; x++) {
+            unsigned int index = (top + y) * params->width + left + x;
+            if (params->quality != NULL)
+                params->quality[index] = ENGINE_QUALITY_EXACT;
+            pass->frame->values[index] = values[y * width + x];
+            pass->frame->magnitudes[index] = magnitudes[y * width + x];
+        }
+    }
+
+    return iterations;
+}
+
+static uint64_t render_tile(void* data, unsigned int task) {
+    const Pass* pass = data;
+    const EngineParams* params = pass->params;
+    if (engine_cancelled(params))
+        return 0;
+
+    unsigned int index = pass->order[task];
+    unsigned int left = pass->left + index % pass->columns * pass->tile_size;
+    unsigned int top = pass->top + index / pass->columns * pass->tile_size;
+    unsigned int right = left + pass->tile_size < pass->right
+                             ? left + pass->tile_size
+                             : pass->right;
+    unsigned int bottom = top + pass->tile_size < pass->bottom
+                              ? top + pass->tile_size
+                              : pass->bottom;
+    unsigned int block = pass->block;
+    uint64_t iterations = 0;
+
+    if (block == 1 && params->subdivide)
+        return subdivide_tile(pass, left, top, right, bottom);
+
+    for (unsigned int y = top; y < bottom; y += block) {
+        unsigned int xs[ENGINE_MAX_TILE_SIZE];
+        unsigned int count = 0;
+
+        for (unsigned int x = left; x < right; x += block) {
+            if (pass->refine && params->quality == NULL &&
+                (x - pass->left) % (2 * block) == 0 &&
+                (y - pass->top) % (2 * block) == 0)
+                continue;
+            if (params->quality != NULL && !needs_sample(pass, x, y))
+                continue;
+
+            xs[count++] = x;
+        }
+
+        sample_row(pass, xs, count, y, &iterations);
+    }
+
+    return iterations;
+}
+
+void engine_pass_begin(const EngineParams* params, EngineParams* pass) {
+    *pass = *params;
+
+    if (engine_is_deep(params)) {
+        if (pass->reference == NULL)
+            pass->reference = reference_orbit_new();
+        reference_orbit_update(pass->reference, params);
+    }
+
+    if (params->fractal_type == FRACTAL_NEWTON) {
+        if (pass->newton_index == NULL)
+            pass->newton_index = newton_index_new();
+        newton_index_update(pass->newton_index, params);
+    }
+}
+
+void engine_pass_end(const EngineParams* params, EngineParams* pass) {
+    if (pass->reference != params->reference)
+        reference_orbit_free(pass->reference);
+    if (pass->newton_index != params->newton_index)
+        newton_index_free(pass->newton_index);
+}
+
+void engine_render_region_pass(const EngineParams* params,
+                               EngineFrame* frame,
+                               unsigned int left,
+                               unsigned int top,
+                               unsigned int width,
+                               unsigned int height,
+                               unsigned int block,
+                               bool refine,
+                               EngineStats* stats) {
+    EngineParams pass_params;
+    engine_pass_begin(params, &pass_params);
+    const EngineParams* original = params;
+    params = &pass_params;
+
+    Pass pass = {
+        .params = params,
+        .frame = frame,
+        .step = engine_step(params),
+        .left = left,
+        .top = top,
+        .right = left + width,
+        .bottom = top + height,
+        .block = block,
+        .refine = refine,
+        .tile_size = ENGINE_MAX_TILE_SIZE,
+    };
+    engine_view_origin(params, &pass.origin_x, &pass.origin_y);
+
+    // Smaller tiles balance better, down to the point where every thread
+    // has several of them. Tiles stay a multiple of `2 * block` so that
+    // refining passes line up with the previous one. Subdivided tiles keep
+    // their size, since what slips between border samples depends on where
+    // the tiles lie, and regions starting at multiples of it then render
+    // the same whatever the thread count.
+    unsigned int wanted = omp_get_max_threads() * ENGINE_TILES_PER_THREAD;
+    while (!(block == 1 && params->subdivide) &&
+           pass.tile_size / 2 >= ENGINE_MIN_TILE_SIZE &&
+           pass.tile_size / 2 >= 2 * block &&
+           ((width + pass.tile_size - 1) / pass.tile_size) *
+                   ((height + pass.tile_size - 1) / pass.tile_size) <
+               wanted) {
+        pass.tile_size /= 2;
+    }
+
+    pass.columns = (width + pass.tile_size - 1) / pass.tile_size;
+    unsigned int rows = (height + pass.tile_size - 1) / pass.tile_size;
+    unsigned int* order = malloc(pass.columns * rows * sizeof(unsigned int));
+    scheduler_order_from_center(pass.columns, rows, order);
+    pass.order = order;
+
+    uint64_t iterations = scheduler_run(pass.columns * rows,
+                                        render_tile,
+                                        &pass,
+                                        stats != NULL ? &stats->threads : NULL);
+    free(order);
+
+    engine_pass_end(original, &pass_params);
+
+    if (stats != NULL)
+        stats->iterations = iterations;
+}
+
+void engine_render_pass(const EngineParams* params,
+                        EngineFrame* frame,
+                        unsigned int block,
+                        bool refine,
+                        EngineStats* stats) {
+    engine_render_region_pass(params,
+                              frame,
+                              0,
+                              0,
+                              params->width,
+                              params->height,
+                              block,
+                              refine,
+                              stats);
+}
+
+void engine_render(const EngineParams* params,
+                   uint32_t* pixels,
+                   EngineStats* stats) {
+    EngineFrame* frame = engine_frame_new(params->width, params->height);
+    engine_render_pass(params, frame, 1, false, stats);
+
+    if (engine_antialias(params) > 1) {
+        EngineStats antialias_stats;
+        antialias_frame(params, frame, &antialias_stats);
+        if (stats != NULL)
+            stats->iterations += antialias_stats.iterations;
+    }
+
+    engine_colorize(params, frame, pixels, params->width);
+    engine_frame_free(frame);
+}
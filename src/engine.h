@@ -0,0 +1,324 @@
+#pragma once
+
+#include <complex.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bignum.h"
+#include "kernel.h"
+#include "palette.h"
+#include "scheduler.h"
+
+// Number of samples handed to the kernels at once.
+#define ENGINE_BATCH_SIZE 64
+
+// Render passes are split into square tiles of these sizes, so that a tile
+// row always fits in one batch.
+#define ENGINE_MAX_TILE_SIZE ENGINE_BATCH_SIZE
+#define ENGINE_MIN_TILE_SIZE 16
+#define ENGINE_TILES_PER_THREAD 8
+
+// Subdivision stops splitting rectangles this thin, and samples them whole.
+#define ENGINE_MIN_SUBDIVISION 8
+
+// Iterations over which colors go once through the palette, unless the
+// params say otherwise.
+#define ENGINE_DEFAULT_COLOR_RAMP 40
+
+// Saturation of the hues of Newton basins.
+#define ENGINE_NEWTON_SATURATION 0.75
+
+// Most samples a pixel on an edge takes when antialiasing.
+#define ENGINE_MAX_ANTIALIAS 64
+
+typedef enum {
+    FRACTAL_MANDELBROT,
+    FRACTAL_JULIA,
+    FRACTAL_NEWTON,
+} FRACTAL_TYPE;
+
+// Per pixel quality of a frame: the block size of the sample a pixel was
+// filled with. A pixel holding its own sample is exact.
+#define ENGINE_QUALITY_EXACT 1
+#define ENGINE_QUALITY_MISSING 255
+
+// Number formats the engine iterates in, from the cheapest. Double-double
+// and BigNum views render through perturbation, with the reference orbit in
+// that format and pixels in double precision.
+typedef enum {
+    PRECISION_AUTO,
+    PRECISION_FLOAT,
+    PRECISION_DOUBLE,
+    PRECISION_DOUBLE_DOUBLE,
+    PRECISION_BIGNUM,
+} PRECISION_TYPE;
+
+#define PRECISION_NUM_TYPES (PRECISION_BIGNUM + 1)
+
+// Automatic precision picks the cheapest format whose pixels are still more
+// than these fractions of their coordinates apart. It never picks float:
+// rounding errors compound over the iterations and visibly change pixels
+// near the boundary even at shallow zoom, so float is only used on request.
+#define ENGINE_DOUBLE_THRESHOLD 1e-14
+#define ENGINE_DOUBLE_DOUBLE_THRESHOLD 1e-28
+
+// Orbit of a reference point, computed at full precision. See perturbation.h.
+typedef struct ReferenceOrbit ReferenceOrbit;
+
+// Spatial index over the roots of a Newton fractal. See newton.h.
+typedef struct NewtonIndex NewtonIndex;
+
+// Everything the engine needs to render one frame. The engine never touches
+// the GTK state, so several renders can run concurrently on different params.
+typedef struct {
+    FRACTAL_TYPE fractal_type;
+
+    unsigned int width;
+    unsigned int height;
+
+    // Bands of a taller view, which exports render one at a time, start
+    // `band_top` rows down the `full_height` rows of the whole view. They
+    // keep its center, grid and reference orbit, so that they come out as
+    // rendering the whole view would. A `full_height` of 0 means the view
+    // is whole.
+    unsigned int band_top;
+    unsigned int full_height;
+
+    double complex center;
+    double complex_width;
+
+    // Full precision `center`, used by deep zooms. Deep renders iterate
+    // around `reference`, which is kept up to date by the passes when not
+    // NULL, and computed for each pass otherwise.
+    BigComplex deep_center;
+    ReferenceOrbit* reference;
+
+    int max_iter;
+    double complex julia_c;
+
+    // Newton renders look roots up through `newton_index`, which is kept up
+    // to date by the passes when not NULL, and built for each pass
+    // otherwise.
+    const double complex* newton_roots;
+    unsigned int newton_num_roots;
+    unsigned int newton_iterations;
+    NewtonIndex* newton_index;
+
+    // Escape-time kernel and number format used for Mandelbrot and Julia
+    // fractals.
+    KERNEL_TYPE kernel;
+    PRECISION_TYPE precision;
+
+    // Whether full resolution passes skip the inside of rectangles whose
+    // border lies inside the set (Mariani-Silver). Exact for Mandelbrot
+    // and connected Julia sets, save for features thin enough to slip
+    // between the border samples.
+    bool subdivide;
+
+    // Samples taken by the pixels on edges, where neighbours differ in
+    // color, once the frame is complete, and whose first few samples vary.
+    // The others keep one, so that this comes close to supersampling the
+    // whole frame as many times for a fraction of the cost. 0 or 1 turn
+    // antialiasing off, and it stops at ENGINE_MAX_ANTIALIAS.
+    unsigned int antialias;
+
+    // When not NULL, rendering stops early once the flag reads true.
+    const atomic_bool* cancel;
+
+    // When not NULL, the quality of every pixel of the output buffer. Passes
+    // only compute the samples that improve on it, and keep it up to date.
+    unsigned char* quality;
+
+    // Only read by engine_colorize(), so changing them never needs the
+    // fractal iterated again. A `color_ramp` of 0 means
+    // ENGINE_DEFAULT_COLOR_RAMP.
+    PALETTE_TYPE palette;
+    unsigned int color_ramp;
+} EngineParams;
+
+// The raw samples of a frame, one per pixel: the values of
+// engine_sample_points() and the magnitudes they come with. Passes fill
+// frames, and engine_colorize() turns them into pixels.
+typedef struct {
+    unsigned int width;
+    unsigned int height;
+    int32_t* values;
+    float* magnitudes;
+
+    // Pixels on edges, and the extra samples each of them got at points
+    // scattered within it, see antialias_frame(): those of edge `i` run from
+    // `edge_start[i]` to `edge_start[i + 1]`. Edge pixels get the average
+    // color of all their samples. Passes leave them alone, so frames whose
+    // samples change have `num_edges` reset to 0.
+    unsigned int num_edges;
+    unsigned int* edges;
+    size_t* edge_start;
+    size_t edge_samples_capacity;
+    int32_t* edge_values;
+    float* edge_magnitudes;
+} EngineFrame;
+
+typedef struct {
+    uint64_t iterations;
+    SchedulerStats threads;
+} EngineStats;
+
+// Samples are laid out on a grid anchored at the origin of the complex
+// plane, with one grid step per pixel. Every view at the same zoom level
+// shares the grid, so samples can be reused between views.
+double engine_step(const EngineParams* params);
+
+// The precision `params` renders at, resolving PRECISION_AUTO. Newton
+// fractals always render in double precision.
+PRECISION_TYPE engine_precision(const EngineParams* params);
+
+// Samples taken by the pixels of `params` on edges, 1 when antialiasing is
+// off.
+unsigned int engine_antialias(const EngineParams* params);
+
+const char* engine_precision_name(PRECISION_TYPE precision);
+
+// PRECISION_TYPE named `name`, or -1 if there is none.
+int engine_precision_from_name(const char* name);
+
+// Whether the view renders through perturbation. The grid of a deep view is
+// anchored at `deep_center` instead of the origin.
+bool engine_is_deep(const EngineParams* params);
+
+// Height of the whole view the band of `params` belongs to, see
+// `full_height`.
+unsigned int engine_full_height(const EngineParams* params);
+
+// Grid coordinates of the top left pixel of the view.
+void engine_view_origin(const EngineParams* params,
+                        double* grid_x,
+                        double* grid_y);
+
+// Escape iteration of each of the `count` points, or -1 if it never
+// escapes, with |z|^2 at escape in `magnitudes` (0 if it never escapes).
+// For Newton fractals, the root the point converges to and the iteration it
+// gets there, see engine_newton_root().
+void engine_sample_points(const EngineParams* params,
+                          const double* re,
+                          const double* im,
+                          unsigned int count,
+                          int32_t* values,
+                          float* magnitudes,
+                          uint64_t* iterations);
+
+// Root index and convergence iteration of a Newton sample value. Points that
+// don't converge within `newton_iterations` count as reaching the closest
+// root at the last iteration.
+unsigned int engine_newton_root(const EngineParams* params, int32_t value);
+unsigned int engine_newton_iteration(const EngineParams* params,
+                                     int32_t value);
+
+// Samples the grid points (`grid_x + xs[i]`, `grid_y`) of one scanline, given
+// the `step` of engine_step(). At most ENGINE_BATCH_SIZE points at a time.
+void engine_sample_scanline(const EngineParams* params,
+                            double step,
+                            double grid_x,
+                            double grid_y,
+                            const unsigned int* xs,
+                            unsigned int count,
+                            int32_t* values,
+                            float* magnitudes,
+                            uint64_t* iterations);
+
+// Fills the `width` x `height` values from (`grid_x`, `grid_y`), at most
+// ENGINE_MAX_TILE_SIZE on each side, by subdividing them into rectangles
+// until their border shares one value, and fills the inside of those that
+// lie inside the set. Values at multiples of `known_block` are already
+// there, unless it is 0.
+void engine_subdivide(const EngineParams* params,
+                      double step,
+                      double grid_x,
+                      double grid_y,
+                      unsigned int width,
+                      unsigned int height,
+                      unsigned int known_block,
+                      int32_t* values,
+                      float* magnitudes,
+                      uint64_t* iterations);
+
+EngineFrame* engine_frame_new(unsigned int width, unsigned int height);
+void engine_frame_free(EngineFrame* frame);
+
+// Colors `count` samples as engine_colorize() does, into opaque 0xAARRGGBB
+// words.
+void engine_color_samples(const EngineParams* params,
+                          const int32_t* values,
+                          const float* magnitudes,
+                          size_t count,
+                          uint32_t* colors);
+
+// Whether `a` and `b` render the same samples, so that a frame of one is a
+// frame of the other, however differently they color it.
+bool engine_same_samples(const EngineParams* a, const EngineParams* b);
+
+// Whether `a` and `b` render the same frame, colors included.
+bool engine_same_frame(const EngineParams* a, const EngineParams* b);
+
+// Colors every sample of `frame` into `pixels`, opaque 0xAARRGGBB words in
+// native byte order with rows `stride` words apart: the layout of a cairo
+// ARGB32 image surface, which can show them as they are. Cheap next to
+// rendering, and all that changing the coloring needs. Escape times are
+// smoothed into a continuous iteration count with the magnitude they escape
+// with, which picks the color in the palette. Newton basins each take a hue
+// of their own, darkened the more steps the point took to reach its root.
+void engine_colorize(const EngineParams* params,
+                     const EngineFrame* frame,
+                     uint32_t* pixels,
+                     unsigned int stride);
+
+bool engine_cancelled(const EngineParams* params);
+
+// Resamples a frame rendered with `from` into the view of `to`, so that it
+// can be shown while `to` renders. Pixels that land on a sample of `from`
+// stay exact when both views render the same fractal. Returns false, leaving
+// the output untouched, when `from` shows a different fractal.
+bool engine_reproject(const EngineParams* from,
+                      const EngineFrame* from_frame,
+                      const unsigned char* from_quality,
+                      const EngineParams* to,
+                      EngineFrame* frame,
+                      unsigned char* quality);
+
+// Copies `params` into `pass`, with the reference orbit and the Newton root
+// index the fractal needs brought up to date. Whichever of them `params`
+// doesn't hold are made for the pass, and freed by engine_pass_end().
+// engine_sample_points() needs them.
+void engine_pass_begin(const EngineParams* params, EngineParams* pass);
+void engine_pass_end(const EngineParams* params, EngineParams* pass);
+
+// Same as engine_render_pass(), restricted to a rectangle of the view.
+// Subdivided rectangles whose corner lies at multiples of
+// ENGINE_MAX_TILE_SIZE come out the same as within a whole pass.
+void engine_render_region_pass(const EngineParams* params,
+                               EngineFrame* frame,
+                               unsigned int left,
+                               unsigned int top,
+                               unsigned int width,
+                               unsigned int height,
+                               unsigned int block,
+                               bool refine,
+                               EngineStats* stats);
+
+// Renders one progressive pass, computing a single sample per `block` x
+// `block` square and filling the square with it. With `refine`, the samples
+// already computed by the previous pass at `2 * block` are left untouched.
+void engine_render_pass(const EngineParams* params,
+                        EngineFrame* frame,
+                        unsigned int block,
+                        bool refine,
+                        EngineStats* stats);
+
+// Renders the frame described by `params` into `pixels`, as
+// engine_colorize() does with `params->width * params->height` words and no
+// padding. `stats` may be NULL, and only counts the passes, not the
+// coloring.
+void engine_render(const EngineParams* params,
+                   uint32_t* pixels,
+                   EngineStats* stats);
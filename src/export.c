@@ -0,0 +1,764 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "export.h"
+#include <complex.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "antialias.h"
+#include "bignum.h"
+#include "cluster.h"
+#include "engine.h"
+#include "kernel.h"
+#include "newton.h"
+#include "palette.h"
+#include "perturbation.h"
+
+#define EXPORT_PI 3.14159265358979323846
+
+// Bands hold about this many pixels, which bounds the memory an export
+// takes whatever the size of the image.
+#define EXPORT_BAND_PIXELS (4 << 20)
+
+// Widest and tallest images exported, a terapixel at most.
+#define EXPORT_MAX_SIZE (1 << 20)
+
+#define DEFAULT_EXPORT_SIZE 4096
+#define DEFAULT_EXPORT_MAX_ITER 256
+#define DEFAULT_EXPORT_NEWTON_ROOTS 3
+#define DEFAULT_EXPORT_NEWTON_ITERATIONS 20
+
+// Row filters of PNG images, which predict every byte from the bytes to its
+// left and above it.
+typedef enum {
+    FILTER_NONE,
+    FILTER_SUB,
+    FILTER_UP,
+    FILTER_AVERAGE,
+    FILTER_PAETH,
+} FILTER_TYPE;
+
+#define NUM_FILTERS (FILTER_PAETH + 1)
+
+// Rendered bands go to the encoder through two slots, so that one renders
+// while the other gets compressed and written.
+typedef struct {
+    mtx_t mutex;
+    cnd_t cond;
+    uint32_t* pixels[2];
+    unsigned int rows[2];
+    bool full[2];
+    bool failed;
+} Pipeline;
+
+// Progress of an export, saved next to the image after every band written
+// to it, so that an interrupted export resumes from the last band written.
+// `adler` is the Adler-32 checksum of the image data written so far.
+typedef struct {
+    unsigned int bands_done;
+    long length;
+    unsigned long adler;
+} Journal;
+
+typedef struct {
+    const char* path;
+    char* journal_path;
+    char* journal_temp_path;
+
+    // The arguments of the export, which a resumed export must share.
+    char* arguments;
+
+    FILE* file;
+    unsigned int width;
+    unsigned int height;
+    unsigned int band_rows;
+    unsigned int num_bands;
+    Journal journal;
+    Pipeline pipeline;
+} Export;
+
+static void print_usage(void) {
+    fprintf(stderr,
+            "Usage: main.out --export FILE.png [--size WIDTHxHEIGHT] "
+            "[--fractal mandelbrot|julia|newton] [--center RE,IM] "
+            "[--complex-width W] [--max-iter N] [--julia-c RE,IM] "
+            "[--roots N] [--newton-iterations N] [--palette NAME] "
+            "[--color-ramp N] [--antialias N] [--subdivide] "
+            "[--workers ADDRESS,...]\n"
+            "Palettes:");
+    for (int palette = 0; palette < PALETTE_NUM_TYPES; palette++) {
+        fprintf(stderr, " %s", palette_name(palette));
+    }
+    fprintf(stderr, "\n");
+}
+
+static void store_u32(unsigned char* bytes, uint32_t value) {
+    bytes[0] = value >> 24;
+    bytes[1] = value >> 16;
+    bytes[2] = value >> 8;
+    bytes[3] = value;
+}
+
+static bool write_chunk(FILE* file,
+                        const char* type,
+                        const unsigned char* data,
+                        size_t size) {
+    unsigned char header[8];
+    store_u32(header, size);
+    memcpy(&header[4], type, 4);
+
+    // crc32() starts over when given no data.
+    unsigned long checksum = crc32(0, &header[4], 4);
+    if (size > 0)
+        checksum = crc32(checksum, data, size);
+    unsigned char crc[4];
+    store_u32(crc, checksum);
+
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+           (size == 0 || fwrite(data, 1, size, file) == size) &&
+           fwrite(crc, 1, sizeof(crc), file) == sizeof(crc);
+}
+
+// Predictor of Paeth filters: whichever of the bytes to the left, above and
+// above left is closest to left + above - above left.
+static unsigned char paeth(unsigned char left,
+                           unsigned char above,
+                           unsigned char above_left) {
+    int estimate = left + above - above_left;
+    int to_left = abs(estimate - left);
+    int to_above = abs(estimate - above);
+    int to_above_left = abs(estimate - above_left);
+    if (to_left <= to_above && to_left <= to_above_left)
+        return left;
+    if (to_above <= to_above_left)
+        return above;
+    return above_left;
+}
+
+// Filters the `size` bytes of `row` into `out` with `filter`, given the row
+// above, which NONE and SUB don't read. Returns the sum of the filtered
+// bytes as signed values, which is lower the better the filter predicts the
+// row.
+static unsigned long filter_row(FILTER_TYPE filter,
+                                const unsigned char* row,
+                                const unsigned char* above,
+                                size_t size,
+                                unsigned char* out) {
+    unsigned long sum = 0;
+    for (size_t i = 0; i < size; i++) {
+        unsigned char left = i >= 3 ? row[i - 3] : 0;
+        unsigned char prediction = 0;
+        switch (filter) {
+            case FILTER_NONE:
+                break;
+            case FILTER_SUB:
+                prediction = left;
+                break;
+            case FILTER_UP:
+                prediction = above[i];
+                break;
+            case FILTER_AVERAGE:
+                prediction = (left + above[i]) / 2;
+                break;
+            case FILTER_PAETH:
+                prediction =
+                    paeth(left, above[i], i >= 3 ? above[i - 3] : 0);
+                break;
+        }
+        out[i] = row[i] - prediction;
+        sum += out[i] < 128 ? out[i] : 256 - out[i];
+    }
+    return sum;
+}
+
+// Turns `rows` rows of 0xAARRGGBB pixels into PNG image data: each row
+// filtered with whichever filter predicts it best, after a byte naming the
+// filter. The first row only gets the filters that ignore the row above,
+// which lies in the previous band, so that bands never depend on one
+// another.
+static void filter_band(const uint32_t* pixels,
+                        unsigned int width,
+                        unsigned int rows,
+                        unsigned char* rgb,
+                        unsigned char* filtered) {
+    size_t size = 3 * (size_t)width;
+    unsigned char* candidate = malloc(size);
+    const unsigned char* above = NULL;
+
+    for (unsigned int y = 0; y < rows; y++) {
+        unsigned char* row = &rgb[(y % 2) * size];
+        for (unsigned int x = 0; x < width; x++) {
+            uint32_t pixel = pixels[(size_t)y * width + x];
+            row[3 * x] = pixel >> 16;
+            row[3 * x + 1] = pixel >> 8;
+            row[3 * x + 2] = pixel;
+        }
+
+        unsigned char* out = &filtered[y * (size + 1)];
+        unsigned long best = ULONG_MAX;
+        FILTER_TYPE last = y == 0 ? FILTER_SUB : FILTER_PAETH;
+        for (FILTER_TYPE filter = 0; filter <= last; filter++) {
+            unsigned long sum =
+                filter_row(filter, row, above, size, candidate);
+            if (sum < best) {
+                best = sum;
+                out[0] = filter;
+                memcpy(&out[1], candidate, size);
+            }
+        }
+
+        above = row;
+    }
+
+    free(candidate);
+}
+
+// Compresses `size` bytes into a raw deflate stream that ends on a byte
+// boundary without referring to anything before it, so that the streams of
+// consecutive bands add up to one.
+static unsigned char* deflate_band(const unsigned char* data,
+                                   size_t size,
+                                   size_t* compressed_size) {
+    z_stream stream = {0};
+    if (deflateInit2(&stream,
+                     Z_DEFAULT_COMPRESSION,
+                     Z_DEFLATED,
+                     -15,
+                     8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        return NULL;
+
+    // Room for the empty stored block of the flush too.
+    size_t capacity = deflateBound(&stream, size) + 16;
+    unsigned char* compressed = malloc(capacity);
+    stream.next_in = (unsigned char*)data;
+    stream.avail_in = size;
+    stream.next_out = compressed;
+    stream.avail_out = capacity;
+
+    int status = deflate(&stream, Z_FULL_FLUSH);
+    *compressed_size = capacity - stream.avail_out;
+    deflateEnd(&stream);
+
+    if (status != Z_OK || stream.avail_in != 0) {
+        free(compressed);
+        return NULL;
+    }
+    return compressed;
+}
+
+static bool save_journal(Export* export) {
+    FILE* file = fopen(export->journal_temp_path, "w");
+    if (file == NULL)
+        return false;
+
+    bool written = fprintf(file,
+                           "%s\n%u %ld %lu\n",
+                           export->arguments,
+                           export->journal.bands_done,
+                           export->journal.length,
+                           export->journal.adler) > 0;
+    written = fflush(file) == 0 && fsync(fileno(file)) == 0 && written;
+    written = fclose(file) == 0 && written;
+
+    // Replaces the previous journal at once, never leaving a partial one.
+    return written &&
+           rename(export->journal_temp_path, export->journal_path) == 0;
+}
+
+// Loads the journal of an interrupted export into `export`. Returns 1 when
+// there is one for the same arguments, 0 when there is none, and -1 when
+// there is one for other arguments.
+static int load_journal(Export* export) {
+    FILE* file = fopen(export->journal_path, "r");
+    if (file == NULL)
+        return 0;
+
+    size_t size = strlen(export->arguments) + 2;
+    char* arguments = malloc(size + 1);
+    bool same = fgets(arguments, size + 1, file) != NULL &&
+                strlen(arguments) == size - 1 &&
+                strncmp(arguments, export->arguments, size - 2) == 0 &&
+                fscanf(file,
+                       "%u %ld %lu",
+                       &export->journal.bands_done,
+                       &export->journal.length,
+                       &export->journal.adler) == 3;
+    free(arguments);
+    fclose(file);
+
+    return same ? 1 : -1;
+}
+
+// Writes the PNG signature and header, and the header of the zlib stream
+// the bands add up to.
+static bool write_header(Export* export) {
+    static const unsigned char signature[8] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+    // 8 bits per channel RGB, without interlacing.
+    unsigned char header[13] = {0};
+    store_u32(header, export->width);
+    store_u32(&header[4], export->height);
+    header[8] = 8;
+    header[9] = 2;
+
+    // Deflate with a 32K window, at the default level.
+    static const unsigned char zlib_header[2] = {0x78, 0x9c};
+
+    return fwrite(signature, 1, sizeof(signature), export->file) ==
+               sizeof(signature) &&
+           write_chunk(export->file, "IHDR", header, sizeof(header)) &&
+           write_chunk(
+               export->file, "IDAT", zlib_header, sizeof(zlib_header));
+}
+
+// Ends the zlib stream with an empty final block and the checksum, and the
+// image.
+static bool write_trailer(Export* export) {
+    unsigned char end[6] = {0x03, 0x00};
+    store_u32(&end[2], export->journal.adler);
+
+    return write_chunk(export->file, "IDAT", end, sizeof(end)) &&
+           write_chunk(export->file, "IEND", NULL, 0);
+}
+
+// Encoder thread: filters, compresses and appends every band to the image
+// as it comes out of the pipeline, saving the journal after each one.
+static int encode_bands(void* data) {
+    Export* export = data;
+    Pipeline* pipeline = &export->pipeline;
+    size_t row_size = 1 + 3 * (size_t)export->width;
+    unsigned char* rgb = malloc(2 * 3 * (size_t)export->width);
+    unsigned char* filtered = malloc(row_size * export->band_rows);
+    bool failed = false;
+
+    for (unsigned int band = export->journal.bands_done;
+         band < export->num_bands && !failed;
+         band++) {
+        unsigned int slot = band % 2;
+        mtx_lock(&pipeline->mutex);
+        while (!pipeline->full[slot])
+            cnd_wait(&pipeline->cond, &pipeline->mutex);
+        mtx_unlock(&pipeline->mutex);
+
+        unsigned int rows = pipeline->rows[slot];
+        filter_band(
+            pipeline->pixels[slot], export->width, rows, rgb, filtered);
+
+        // The slot can take the band after next while this one compresses.
+        mtx_lock(&pipeline->mutex);
+        pipeline->full[slot] = false;
+        cnd_broadcast(&pipeline->cond);
+        mtx_unlock(&pipeline->mutex);
+
+        size_t size = row_size * rows;
+        size_t compressed_size;
+        unsigned char* compressed =
+            deflate_band(filtered, size, &compressed_size);
+
+        // The image data is on disk before the journal says so.
+        failed = compressed == NULL ||
+                 !write_chunk(
+                     export->file, "IDAT", compressed, compressed_size) ||
+                 fflush(export->file) != 0 ||
+                 fsync(fileno(export->file)) != 0;
+        free(compressed);
+        if (failed)
+            break;
+
+        export->journal.adler = adler32_combine(
+            export->journal.adler, adler32(1, filtered, size), size);
+        export->journal.bands_done = band + 1;
+        export->journal.length = ftell(export->file);
+        failed = !save_journal(export);
+
+        fprintf(stderr,
+                "\rExported %u of %u bands",
+                export->journal.bands_done,
+                export->num_bands);
+    }
+    fprintf(stderr, "\n");
+
+    free(filtered);
+    free(rgb);
+
+    if (failed) {
+        mtx_lock(&pipeline->mutex);
+        pipeline->failed = true;
+        cnd_broadcast(&pipeline->cond);
+        mtx_unlock(&pipeline->mutex);
+    }
+    return failed;
+}
+
+// Renders `rows` rows of `image` from `first_row` into `pixels`, as a band
+// of the whole image, see EngineParams.full_height. The workers of
+// `cluster` iterate them unless it is NULL.
+static void render_band(const EngineParams* image,
+                        unsigned int first_row,
+                        unsigned int rows,
+                        Cluster* cluster,
+                        EngineFrame* frame,
+                        uint32_t* pixels) {
+    EngineParams band = *image;
+    band.height = rows;
+    band.band_top = first_row;
+    band.full_height = image->height;
+
+    if (cluster != NULL) {
+        cluster_render(cluster, &band, frame, NULL);
+    } else {
+        engine_render_pass(&band, frame, 1, false, NULL);
+    }
+    if (engine_antialias(&band) > 1)
+        antialias_frame(&band, frame, NULL);
+    engine_colorize(&band, frame, pixels, band.width);
+}
+
+// Parses a decimal number from 1 to `max` into `value`.
+static bool parse_count(const char* arg,
+                        unsigned int max,
+                        unsigned int* value) {
+    // strtoul() takes leading spaces and signs, and negates what follows a
+    // minus sign.
+    if (*arg < '0' || *arg > '9')
+        return false;
+
+    char* end;
+    errno = 0;
+    unsigned long parsed = strtoul(arg, &end, 10);
+    if (errno != 0 || *end != '\0' || parsed == 0 || parsed > max)
+        return false;
+    *value = parsed;
+    return true;
+}
+
+// Parses "WIDTHxHEIGHT" into `width` and `height`.
+static bool parse_size(char* arg, unsigned int* width, unsigned int* height) {
+    char* x = strchr(arg, 'x');
+    if (x == NULL)
+        return false;
+    *x = '\0';
+
+    return parse_count(arg, EXPORT_MAX_SIZE, width) &&
+           parse_count(x + 1, EXPORT_MAX_SIZE, height);
+}
+
+// Parses "RE,IM" into `value`, and into `deep_value` at full precision
+// unless it is NULL.
+static bool parse_complex(char* arg,
+                          double complex* value,
+                          BigComplex* deep_value) {
+    char* comma = strchr(arg, ',');
+    if (comma == NULL)
+        return false;
+    *comma = '\0';
+    char* im = comma + 1;
+
+    char* end;
+    double re_value = strtod(arg, &end);
+    if (*end != '\0')
+        return false;
+    double im_value = strtod(im, &end);
+    if (*end != '\0')
+        return false;
+    *value = re_value + im_value * I;
+
+    return deep_value == NULL ||
+           (bignum_from_string(arg, &deep_value->re) &&
+            bignum_from_string(im, &deep_value->im));
+}
+
+// Joins the arguments into one line, for the journal. Workers render the
+// same image as this process, and are left out.
+static char* join_arguments(int argc, char* argv[]) {
+    size_t size = 1;
+    for (int i = 0; i < argc; i++) {
+        size += strlen(argv[i]) + 1;
+    }
+
+    char* arguments = malloc(size);
+    arguments[0] = '\0';
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--workers") == 0) {
+            i++;
+            continue;
+        }
+        if (arguments[0] != '\0')
+            strcat(arguments, " ");
+        strcat(arguments, argv[i]);
+    }
+    return arguments;
+}
+
+static char* path_with_suffix(const char* path, const char* suffix) {
+    char* result = malloc(strlen(path) + strlen(suffix) + 1);
+    strcpy(result, path);
+    strcat(result, suffix);
+    return result;
+}
+
+int export_main(int argc, char* argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        print_usage();
+        return 1;
+    }
+
+    Export export = {
+        .path = argv[1],
+        .width = DEFAULT_EXPORT_SIZE,
+        .height = DEFAULT_EXPORT_SIZE,
+    };
+    export.arguments = join_arguments(argc - 1, argv + 1);
+
+    EngineParams image = {
+        .fractal_type = FRACTAL_MANDELBROT,
+        .complex_width = 3,
+        .max_iter = DEFAULT_EXPORT_MAX_ITER,
+        .julia_c = 0.5 * I,
+        .newton_num_roots = DEFAULT_EXPORT_NEWTON_ROOTS,
+        .newton_iterations = DEFAULT_EXPORT_NEWTON_ITERATIONS,
+        .kernel = kernel_best(),
+        .deep_center = bigcomplex_from_complex(0),
+    };
+
+    const char* workers = NULL;
+    bool valid = true;
+    for (int i = 2; i < argc && valid; i++) {
+        if (strcmp(argv[i], "--subdivide") == 0) {
+            image.subdivide = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            valid = false;
+            break;
+        }
+
+        char* value = argv[++i];
+        if (strcmp(argv[i - 1], "--size") == 0) {
+            valid = parse_size(value, &export.width, &export.height);
+        } else if (strcmp(argv[i - 1], "--fractal") == 0) {
+            if (strcmp(value, "mandelbrot") == 0) {
+                image.fractal_type = FRACTAL_MANDELBROT;
+            } else if (strcmp(value, "julia") == 0) {
+                image.fractal_type = FRACTAL_JULIA;
+            } else if (strcmp(value, "newton") == 0) {
+                image.fractal_type = FRACTAL_NEWTON;
+            } else {
+                valid = false;
+            }
+        } else if (strcmp(argv[i - 1], "--center") == 0) {
+            valid = parse_complex(value, &image.center, &image.deep_center);
+        } else if (strcmp(argv[i - 1], "--complex-width") == 0) {
+            char* end;
+            image.complex_width = strtod(value, &end);
+            valid = *end == '\0' && isfinite(image.complex_width) &&
+                    image.complex_width > 0;
+        } else if (strcmp(argv[i - 1], "--max-iter") == 0) {
+            unsigned int max_iter;
+            valid = parse_count(value, INT_MAX, &max_iter);
+            image.max_iter = max_iter;
+        } else if (strcmp(argv[i - 1], "--julia-c") == 0) {
+            valid = parse_complex(value, &image.julia_c, NULL);
+        } else if (strcmp(argv[i - 1], "--roots") == 0) {
+            valid = parse_count(value, INT_MAX, &image.newton_num_roots);
+        } else if (strcmp(argv[i - 1], "--newton-iterations") == 0) {
+            valid = parse_count(value, INT_MAX, &image.newton_iterations);
+        } else if (strcmp(argv[i - 1], "--palette") == 0) {
+            int palette = palette_from_name(value);
+            image.palette = palette;
+            valid = palette >= 0;
+        } else if (strcmp(argv[i - 1], "--color-ramp") == 0) {
+            valid = parse_count(value, UINT_MAX, &image.color_ramp);
+        } else if (strcmp(argv[i - 1], "--antialias") == 0) {
+            valid = parse_count(value, UINT_MAX, &image.antialias);
+        } else if (strcmp(argv[i - 1], "--workers") == 0) {
+            workers = value;
+        } else {
+            valid = false;
+        }
+    }
+
+    // Newton samples hold the iteration and the root in one int32_t.
+    if ((uint64_t)(image.newton_iterations + 1) * image.newton_num_roots >
+        INT32_MAX)
+        valid = false;
+    if (!valid) {
+        print_usage();
+        free(export.arguments);
+        return 1;
+    }
+
+    double complex* roots =
+        malloc(image.newton_num_roots * sizeof(double complex));
+    for (unsigned int i = 0; i < image.newton_num_roots; i++) {
+        roots[i] = cexp(2 * EXPORT_PI * I * i / image.newton_num_roots);
+    }
+    image.newton_roots = roots;
+
+    // The precision is that of the whole image, whatever the band, and the
+    // reference orbit and the root index carry over from band to band.
+    image.width = export.width;
+    image.height = export.height;
+    image.precision = engine_precision(&image);
+    image.reference = reference_orbit_new();
+    image.newton_index = newton_index_new();
+
+    Cluster* cluster = NULL;
+    if (workers != NULL) {
+        cluster = cluster_new(workers);
+        if (cluster == NULL)
+            fprintf(stderr, "No worker could be reached, rendering here\n");
+    }
+
+    // Bands start on the tiles of a whole render, or subdivision could find
+    // other rectangles than it does there.
+    export.band_rows = EXPORT_BAND_PIXELS / export.width /
+                       ENGINE_MAX_TILE_SIZE * ENGINE_MAX_TILE_SIZE;
+    if (export.band_rows == 0)
+        export.band_rows = ENGINE_MAX_TILE_SIZE;
+    if (export.band_rows > export.height)
+        export.band_rows = export.height;
+    export.num_bands = (export.height + export.band_rows - 1) /
+                       export.band_rows;
+    export.journal_path = path_with_suffix(export.path, ".journal");
+    export.journal_temp_path = path_with_suffix(export.path, ".journal.tmp");
+
+    int status = 1;
+    int resumed = load_journal(&export);
+    if (resumed < 0) {
+        fprintf(stderr,
+                "%s is being exported with other arguments, remove %s to "
+                "start over\n",
+                export.path,
+                export.journal_path);
+    } else if (resumed > 0) {
+        // Whatever got written past the last band journaled goes.
+        export.file = fopen(export.path, "r+b");
+        if (export.file != NULL &&
+            (ftruncate(fileno(export.file), export.journal.length) != 0 ||
+             fseek(export.file, export.journal.length, SEEK_SET) != 0)) {
+            fclose(export.file);
+            export.file = NULL;
+        }
+        if (export.file != NULL)
+            fprintf(stderr,
+                    "Resuming %s from band %u of %u\n",
+                    export.path,
+                    export.journal.bands_done + 1,
+                    export.num_bands);
+    } else {
+        export.file = fopen(export.path, "wb");
+        export.journal = (Journal){.adler = adler32(0, NULL, 0)};
+        if (export.file != NULL &&
+            (!write_header(&export) || fflush(export.file) != 0 ||
+             (export.journal.length = ftell(export.file)) < 0 ||
+             !save_journal(&export))) {
+            fclose(export.file);
+            export.file = NULL;
+        }
+    }
+
+    if (resumed >= 0 && export.file == NULL)
+        perror(export.path);
+
+    if (export.file != NULL) {
+        Pipeline* pipeline = &export.pipeline;
+        mtx_init(&pipeline->mutex, mtx_plain);
+        cnd_init(&pipeline->cond);
+        for (unsigned int slot = 0; slot < 2; slot++) {
+            pipeline->pixels[slot] = malloc((size_t)export.width *
+                                            export.band_rows *
+                                            sizeof(uint32_t));
+        }
+
+        // Without an encoder, nothing renders, and the file and the journal
+        // stay as they were, ready to resume.
+        thrd_t encoder;
+        bool encoding =
+            thrd_create(&encoder, encode_bands, &export) == thrd_success;
+        if (!encoding)
+            fprintf(stderr, "Could not start encoding %s\n", export.path);
+
+        EngineFrame* frame = NULL;
+        for (unsigned int band = export.journal.bands_done;
+             encoding && band < export.num_bands;
+             band++) {
+            unsigned int slot = band % 2;
+            unsigned int first_row = band * export.band_rows;
+            unsigned int rows = export.height - first_row < export.band_rows
+                                    ? export.height - first_row
+                                    : export.band_rows;
+
+            mtx_lock(&pipeline->mutex);
+            while (pipeline->full[slot] && !pipeline->failed)
+                cnd_wait(&pipeline->cond, &pipeline->mutex);
+            bool failed = pipeline->failed;
+            mtx_unlock(&pipeline->mutex);
+            if (failed)
+                break;
+
+            if (frame == NULL || frame->height != rows) {
+                if (frame != NULL)
+                    engine_frame_free(frame);
+                frame = engine_frame_new(export.width, rows);
+            }
+            render_band(&image,
+                        first_row,
+                        rows,
+                        cluster,
+                        frame,
+                        pipeline->pixels[slot]);
+
+            mtx_lock(&pipeline->mutex);
+            pipeline->rows[slot] = rows;
+            pipeline->full[slot] = true;
+            cnd_broadcast(&pipeline->cond);
+            mtx_unlock(&pipeline->mutex);
+        }
+        if (frame != NULL)
+            engine_frame_free(frame);
+
+        int failed = 1;
+        if (encoding)
+            thrd_join(encoder, &failed);
+
+        if (!failed && write_trailer(&export) && fflush(export.file) == 0) {
+            status = 0;
+        } else if (encoding) {
+            perror(export.path);
+        }
+        if (fclose(export.file) != 0)
+            status = 1;
+        if (status == 0)
+            remove(export.journal_path);
+
+        for (unsigned int slot = 0; slot < 2; slot++) {
+            free(pipeline->pixels[slot]);
+        }
+        cnd_destroy(&pipeline->cond);
+        mtx_destroy(&pipeline->mutex);
+    }
+
+    if (cluster != NULL)
+        cluster_free(cluster);
+    newton_index_free(image.newton_index);
+    reference_orbit_free(image.reference);
+    free(roots);
+    free(export.journal_temp_path);
+    free(export.journal_path);
+    free(export.arguments);
+    return status;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Headless entry point for `main.out --export`. Renders a view of any size
+// into a PNG file, a band of rows at a time, so that memory stays bounded
+// however large the image. Bands are compressed and written while the next
+// one renders, and an interrupted export picks up where it stopped when run
+// again with the same arguments.
+int export_main(int argc, char* argv[]);
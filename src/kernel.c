@@ -0,0 +1,1058 @@
+#include "kernel.h"
+#include <complex.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNEL_X86
+#include <immintrin.h>
+#endif
+
+// Lanes past the last point start here, and escape on the first iteration.
+#define LANE_PADDING 4.0
+
+// Brent's cycle detection: an orbit that comes back within this distance,
+// in the 1-norm, of where it was at the last power of two iterations has
+// settled into an attracting cycle.
+#define PERIODICITY_TOLERANCE 1e-12
+#define PERIODICITY_TOLERANCE_FLOAT 1e-5f
+
+// Whether the orbit is due to save its position after iteration `n`.
+#define PERIODICITY_SAVE(n) (((n) & ((n) + 1)) == 0)
+
+static const char* kernel_names[KERNEL_NUM_TYPES] = {
+    [KERNEL_AUTO] = "auto",
+    [KERNEL_SCALAR] = "scalar",
+    [KERNEL_SSE2] = "sse2",
+    [KERNEL_AVX2] = "avx2",
+    [KERNEL_AVX512] = "avx512",
+};
+
+// Whether c lies in the main cardioid or the period-2 bulb, whose points
+// never escape.
+static bool in_interior(double re, double im) {
+    double dx = re - 0.25;
+    double p = sqrt(dx * dx + im * im);
+    double bulb_x = re + 1;
+    return re < p - (p + p) * p + 0.25 ||
+           bulb_x * bulb_x + im * im < 0.0625;
+}
+
+static int32_t escape_time_scalar(double zr,
+                                  double zi,
+                                  double cr,
+                                  double ci,
+                                  int max_iter,
+                                  float* magnitude,
+                                  uint64_t* iterations) {
+    double saved_r = zr;
+    double saved_i = zi;
+    *magnitude = 0;
+    for (int i = 0; i < max_iter; i++) {
+        double zri = zr * zi;
+        zr = zr * zr - zi * zi + cr;
+        zi = zri + zri + ci;
+        if (zr * zr + zi * zi > 4) {
+            *magnitude = zr * zr + zi * zi;
+            *iterations += i + 1;
+            return i;
+        }
+
+        if (fabs(zr - saved_r) + fabs(zi - saved_i) < PERIODICITY_TOLERANCE) {
+            *iterations += i + 1;
+            return -1;
+        }
+        if (PERIODICITY_SAVE(i)) {
+            saved_r = zr;
+            saved_i = zi;
+        }
+    }
+    *iterations += max_iter;
+    return -1;
+}
+
+static void escape_times_scalar(bool mandelbrot,
+                                double complex julia_c,
+                                int max_iter,
+                                const double* re,
+                                const double* im,
+                                unsigned int count,
+                                int32_t* values,
+                                float* magnitudes,
+                                uint64_t* iterations) {
+    for (unsigned int i = 0; i < count; i++) {
+        if (!mandelbrot) {
+            values[i] = escape_time_scalar(re[i],
+                                           im[i],
+                                           creal(julia_c),
+                                           cimag(julia_c),
+                                           max_iter,
+                                           &magnitudes[i],
+                                           iterations);
+        } else if (in_interior(re[i], im[i])) {
+            values[i] = -1;
+            magnitudes[i] = 0;
+        } else {
+            values[i] = escape_time_scalar(
+                0, 0, re[i], im[i], max_iter, &magnitudes[i], iterations);
+        }
+    }
+}
+
+static bool in_interior_float(float re, float im) {
+    float dx = re - 0.25f;
+    float p = sqrtf(dx * dx + im * im);
+    float bulb_x = re + 1;
+    return re < p - (p + p) * p + 0.25f ||
+           bulb_x * bulb_x + im * im < 0.0625f;
+}
+
+static int32_t escape_time_scalar_float(float zr,
+                                        float zi,
+                                        float cr,
+                                        float ci,
+                                        int max_iter,
+                                        float* magnitude,
+                                        uint64_t* iterations) {
+    float saved_r = zr;
+    float saved_i = zi;
+    *magnitude = 0;
+    for (int i = 0; i < max_iter; i++) {
+        float zri = zr * zi;
+        zr = zr * zr - zi * zi + cr;
+        zi = zri + zri + ci;
+        if (zr * zr + zi * zi > 4) {
+            *magnitude = zr * zr + zi * zi;
+            *iterations += i + 1;
+            return i;
+        }
+
+        if (fabsf(zr - saved_r) + fabsf(zi - saved_i) <
+            PERIODICITY_TOLERANCE_FLOAT) {
+            *iterations += i + 1;
+            return -1;
+        }
+        if (PERIODICITY_SAVE(i)) {
+            saved_r = zr;
+            saved_i = zi;
+        }
+    }
+    *iterations += max_iter;
+    return -1;
+}
+
+static void escape_times_scalar_float(bool mandelbrot,
+                                      double complex julia_c,
+                                      int max_iter,
+                                      const double* re,
+                                      const double* im,
+                                      unsigned int count,
+                                      int32_t* values,
+                                      float* magnitudes,
+                                      uint64_t* iterations) {
+    for (unsigned int i = 0; i < count; i++) {
+        float x = re[i];
+        float y = im[i];
+        if (!mandelbrot) {
+            values[i] = escape_time_scalar_float(x,
+                                                 y,
+                                                 creal(julia_c),
+                                                 cimag(julia_c),
+                                                 max_iter,
+                                                 &magnitudes[i],
+                                                 iterations);
+        } else if (in_interior_float(x, y)) {
+            values[i] = -1;
+            magnitudes[i] = 0;
+        } else {
+            values[i] = escape_time_scalar_float(
+                0, 0, x, y, max_iter, &magnitudes[i], iterations);
+        }
+    }
+}
+
+#ifdef KERNEL_X86
+
+// Copies the points of one vector, padding the lanes past `count`.
+static void load_lanes(const double* re,
+                       const double* im,
+                       unsigned int count,
+                       unsigned int width,
+                       double* lane_re,
+                       double* lane_im) {
+    for (unsigned int lane = 0; lane < width; lane++) {
+        bool used = lane < count;
+        lane_re[lane] = used ? re[lane] : LANE_PADDING;
+        lane_im[lane] = used ? im[lane] : 0;
+    }
+}
+
+// `escapes` holds the escape iteration of every lane, -1 if it never
+// escaped, or -2 - n if it was found periodic at iteration n, and
+// `escape_magnitudes` |z|^2 at the escape. `interior` has
+// a bit set for each lane that skipped iterating as part of the main
+// cardioid or the period-2 bulb.
+static void store_lanes(const double* escapes,
+                        const double* escape_magnitudes,
+                        unsigned int interior,
+                        unsigned int count,
+                        int max_iter,
+                        int32_t* values,
+                        float* magnitudes,
+                        uint64_t* iterations) {
+    for (unsigned int lane = 0; lane < count; lane++) {
+        magnitudes[lane] = 0;
+        if (escapes[lane] >= 0) {
+            values[lane] = escapes[lane];
+            magnitudes[lane] = escape_magnitudes[lane];
+            *iterations += values[lane] + 1;
+        } else if (escapes[lane] < -1) {
+            values[lane] = -1;
+            *iterations += -1 - (int32_t)escapes[lane];
+        } else {
+            values[lane] = -1;
+            if (!(interior & (1u << lane)))
+                *iterations += max_iter;
+        }
+    }
+}
+
+__attribute__((target("sse2"))) static void escape_times_sse2(
+    bool mandelbrot,
+    double complex julia_c,
+    int max_iter,
+    const double* re,
+    const double* im,
+    unsigned int count,
+    int32_t* values,
+    float* magnitudes,
+    uint64_t* iterations) {
+    const __m128d one = _mm_set1_pd(1);
+    const __m128d four = _mm_set1_pd(4);
+    const __m128d minus_two = _mm_set1_pd(-2);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    const __m128d tolerance = _mm_set1_pd(PERIODICITY_TOLERANCE);
+
+    for (unsigned int i = 0; i < count; i += 2) {
+        unsigned int lanes = count - i < 2 ? count - i : 2;
+        double lane_re[2], lane_im[2];
+        load_lanes(&re[i], &im[i], lanes, 2, lane_re, lane_im);
+
+        __m128d x = _mm_loadu_pd(lane_re);
+        __m128d y = _mm_loadu_pd(lane_im);
+        __m128d zr, zi, cr, ci;
+        __m128d active = _mm_cmpeq_pd(x, x);
+        unsigned int interior = 0;
+
+        if (mandelbrot) {
+            zr = _mm_setzero_pd();
+            zi = _mm_setzero_pd();
+            cr = x;
+            ci = y;
+
+            __m128d dx = _mm_sub_pd(x, _mm_set1_pd(0.25));
+            __m128d p = _mm_sqrt_pd(
+                _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(y, y)));
+            __m128d bound = _mm_add_pd(
+                _mm_sub_pd(p, _mm_mul_pd(_mm_add_pd(p, p), p)),
+                _mm_set1_pd(0.25));
+            __m128d bulb_x = _mm_add_pd(x, one);
+            __m128d bulb = _mm_cmplt_pd(
+                _mm_add_pd(_mm_mul_pd(bulb_x, bulb_x), _mm_mul_pd(y, y)),
+                _mm_set1_pd(0.0625));
+            __m128d skipped = _mm_or_pd(_mm_cmplt_pd(x, bound), bulb);
+            interior = _mm_movemask_pd(skipped);
+            active = _mm_andnot_pd(skipped, active);
+        } else {
+            zr = x;
+            zi = y;
+            cr = _mm_set1_pd(creal(julia_c));
+            ci = _mm_set1_pd(cimag(julia_c));
+        }
+
+        __m128d escape_magnitudes = _mm_setzero_pd();
+        __m128d escapes = _mm_set1_pd(-1);
+        __m128d iteration = _mm_setzero_pd();
+        __m128d saved_r = zr;
+        __m128d saved_i = zi;
+        for (int n = 0; n < max_iter && _mm_movemask_pd(active); n++) {
+            __m128d zri = _mm_mul_pd(zr, zi);
+            zr = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(zr, zr), _mm_mul_pd(zi, zi)),
+                            cr);
+            zi = _mm_add_pd(_mm_add_pd(zri, zri), ci);
+
+            __m128d magnitude =
+                _mm_add_pd(_mm_mul_pd(zr, zr), _mm_mul_pd(zi, zi));
+            __m128d escaped =
+                _mm_and_pd(_mm_cmpgt_pd(magnitude, four), active);
+            escapes = _mm_or_pd(_mm_andnot_pd(escaped, escapes),
+                                _mm_and_pd(escaped, iteration));
+            escape_magnitudes =
+                _mm_or_pd(_mm_andnot_pd(escaped, escape_magnitudes),
+                          _mm_and_pd(escaped, magnitude));
+            active = _mm_andnot_pd(escaped, active);
+
+            __m128d distance = _mm_add_pd(
+                _mm_andnot_pd(sign, _mm_sub_pd(zr, saved_r)),
+                _mm_andnot_pd(sign, _mm_sub_pd(zi, saved_i)));
+            __m128d periodic =
+                _mm_and_pd(_mm_cmplt_pd(distance, tolerance), active);
+            escapes = _mm_or_pd(
+                _mm_andnot_pd(periodic, escapes),
+                _mm_and_pd(periodic, _mm_sub_pd(minus_two, iteration)));
+            active = _mm_andnot_pd(periodic, active);
+            if (PERIODICITY_SAVE(n)) {
+                saved_r = zr;
+                saved_i = zi;
+            }
+
+            iteration = _mm_add_pd(iteration, one);
+        }
+
+        double lane_escapes[2], lane_magnitudes[2];
+        _mm_storeu_pd(lane_escapes, escapes);
+        _mm_storeu_pd(lane_magnitudes, escape_magnitudes);
+        store_lanes(lane_escapes,
+                    lane_magnitudes,
+                    interior,
+                    lanes,
+                    max_iter,
+                    &values[i],
+                    &magnitudes[i],
+                    iterations);
+    }
+}
+
+__attribute__((target("avx2"))) static void escape_times_avx2(
+    bool mandelbrot,
+    double complex julia_c,
+    int max_iter,
+    const double* re,
+    const double* im,
+    unsigned int count,
+    int32_t* values,
+    float* magnitudes,
+    uint64_t* iterations) {
+    const __m256d one = _mm256_set1_pd(1);
+    const __m256d four = _mm256_set1_pd(4);
+    const __m256d minus_two = _mm256_set1_pd(-2);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d tolerance = _mm256_set1_pd(PERIODICITY_TOLERANCE);
+
+    for (unsigned int i = 0; i < count; i += 4) {
+        unsigned int lanes = count - i < 4 ? count - i : 4;
+        double lane_re[4], lane_im[4];
+        load_lanes(&re[i], &im[i], lanes, 4, lane_re, lane_im);
+
+        __m256d x = _mm256_loadu_pd(lane_re);
+        __m256d y = _mm256_loadu_pd(lane_im);
+        __m256d zr, zi, cr, ci;
+        __m256d active = _mm256_cmp_pd(x, x, _CMP_EQ_OQ);
+        unsigned int interior = 0;
+
+        if (mandelbrot) {
+            zr = _mm256_setzero_pd();
+            zi = _mm256_setzero_pd();
+            cr = x;
+            ci = y;
+
+            __m256d dx = _mm256_sub_pd(x, _mm256_set1_pd(0.25));
+            __m256d p = _mm256_sqrt_pd(
+                _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(y, y)));
+            __m256d bound = _mm256_add_pd(
+                _mm256_sub_pd(p, _mm256_mul_pd(_mm256_add_pd(p, p), p)),
+                _mm256_set1_pd(0.25));
+            __m256d bulb_x = _mm256_add_pd(x, one);
+            __m256d bulb = _mm256_cmp_pd(
+                _mm256_add_pd(_mm256_mul_pd(bulb_x, bulb_x),
+                              _mm256_mul_pd(y, y)),
+                _mm256_set1_pd(0.0625),
+                _CMP_LT_OQ);
+            __m256d skipped =
+                _mm256_or_pd(_mm256_cmp_pd(x, bound, _CMP_LT_OQ), bulb);
+            interior = _mm256_movemask_pd(skipped);
+            active = _mm256_andnot_pd(skipped, active);
+        } else {
+            zr = x;
+            zi = y;
+            cr = _mm256_set1_pd(creal(julia_c));
+            ci = _mm256_set1_pd(cimag(julia_c));
+        }
+
+        __m256d escape_magnitudes = _mm256_setzero_pd();
+        __m256d escapes = _mm256_set1_pd(-1);
+        __m256d iteration = _mm256_setzero_pd();
+        __m256d saved_r = zr;
+        __m256d saved_i = zi;
+        for (int n = 0; n < max_iter && _mm256_movemask_pd(active); n++) {
+            __m256d zri = _mm256_mul_pd(zr, zi);
+            zr = _mm256_add_pd(
+                _mm256_sub_pd(_mm256_mul_pd(zr, zr), _mm256_mul_pd(zi, zi)),
+                cr);
+            zi = _mm256_add_pd(_mm256_add_pd(zri, zri), ci);
+
+            __m256d magnitude =
+                _mm256_add_pd(_mm256_mul_pd(zr, zr), _mm256_mul_pd(zi, zi));
+            __m256d escaped = _mm256_and_pd(
+                _mm256_cmp_pd(magnitude, four, _CMP_GT_OQ), active);
+            escapes = _mm256_blendv_pd(escapes, iteration, escaped);
+            escape_magnitudes =
+                _mm256_blendv_pd(escape_magnitudes, magnitude, escaped);
+            active = _mm256_andnot_pd(escaped, active);
+
+            __m256d distance = _mm256_add_pd(
+                _mm256_andnot_pd(sign, _mm256_sub_pd(zr, saved_r)),
+                _mm256_andnot_pd(sign, _mm256_sub_pd(zi, saved_i)));
+            __m256d periodic = _mm256_and_pd(
+                _mm256_cmp_pd(distance, tolerance, _CMP_LT_OQ), active);
+            escapes = _mm256_blendv_pd(
+                escapes, _mm256_sub_pd(minus_two, iteration), periodic);
+            active = _mm256_andnot_pd(periodic, active);
+            if (PERIODICITY_SAVE(n)) {
+                saved_r = zr;
+                saved_i = zi;
+            }
+
+            iteration = _mm256_add_pd(iteration, one);
+        }
+
+        double lane_escapes[4], lane_magnitudes[4];
+        _mm256_storeu_pd(lane_escapes, escapes);
+        _mm256_storeu_pd(lane_magnitudes, escape_magnitudes);
+        store_lanes(lane_escapes,
+                    lane_magnitudes,
+                    interior,
+                    lanes,
+                    max_iter,
+                    &values[i],
+                    &magnitudes[i],
+                    iterations);
+    }
+}
+
+__attribute__((target("avx512f"))) static void escape_times_avx512(
+    bool mandelbrot,
+    double complex julia_c,
+    int max_iter,
+    const double* re,
+    const double* im,
+    unsigned int count,
+    int32_t* values,
+    float* magnitudes,
+    uint64_t* iterations) {
+    const __m512d one = _mm512_set1_pd(1);
+    const __m512d four = _mm512_set1_pd(4);
+    const __m512d minus_two = _mm512_set1_pd(-2);
+    const __m512d tolerance = _mm512_set1_pd(PERIODICITY_TOLERANCE);
+
+    for (unsigned int i = 0; i < count; i += 8) {
+        unsigned int lanes = count - i < 8 ? count - i : 8;
+        double lane_re[8], lane_im[8];
+        load_lanes(&re[i], &im[i], lanes, 8, lane_re, lane_im);
+
+        __m512d x = _mm512_loadu_pd(lane_re);
+        __m512d y = _mm512_loadu_pd(lane_im);
+        __m512d zr, zi, cr, ci;
+        __mmask8 active = 0xff;
+        unsigned int interior = 0;
+
+        if (mandelbrot) {
+            zr = _mm512_setzero_pd();
+            zi = _mm512_setzero_pd();
+            cr = x;
+            ci = y;
+
+            __m512d dx = _mm512_sub_pd(x, _mm512_set1_pd(0.25));
+            __m512d p = _mm512_sqrt_pd(
+                _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(y, y)));
+            __m512d bound = _mm512_add_pd(
+                _mm512_sub_pd(p, _mm512_mul_pd(_mm512_add_pd(p, p), p)),
+                _mm512_set1_pd(0.25));
+            __m512d bulb_x = _mm512_add_pd(x, one);
+            __mmask8 bulb = _mm512_cmp_pd_mask(
+                _mm512_add_pd(_mm512_mul_pd(bulb_x, bulb_x),
+                              _mm512_mul_pd(y, y)),
+                _mm512_set1_pd(0.0625),
+                _CMP_LT_OQ);
+            __mmask8 skipped = _mm512_cmp_pd_mask(x, bound, _CMP_LT_OQ) | bulb;
+            interior = skipped;
+            active &= ~skipped;
+        } else {
+            zr = x;
+            zi = y;
+            cr = _mm512_set1_pd(creal(julia_c));
+            ci = _mm512_set1_pd(cimag(julia_c));
+        }
+
+        __m512d escape_magnitudes = _mm512_setzero_pd();
+        __m512d escapes = _mm512_set1_pd(-1);
+        __m512d iteration = _mm512_setzero_pd();
+        __m512d saved_r = zr;
+        __m512d saved_i = zi;
+        for (int n = 0; n < max_iter && active; n++) {
+            __m512d zri = _mm512_mul_pd(zr, zi);
+            zr = _mm512_add_pd(
+                _mm512_sub_pd(_mm512_mul_pd(zr, zr), _mm512_mul_pd(zi, zi)),
+                cr);
+            zi = _mm512_add_pd(_mm512_add_pd(zri, zri), ci);
+
+            __m512d magnitude =
+                _mm512_add_pd(_mm512_mul_pd(zr, zr), _mm512_mul_pd(zi, zi));
+            __mmask8 escaped =
+                _mm512_mask_cmp_pd_mask(active, magnitude, four, _CMP_GT_OQ);
+            escapes = _mm512_mask_blend_pd(escaped, escapes, iteration);
+            escape_magnitudes =
+                _mm512_mask_blend_pd(escaped, escape_magnitudes, magnitude);
+            active &= ~escaped;
+
+            __m512d distance =
+                _mm512_add_pd(_mm512_abs_pd(_mm512_sub_pd(zr, saved_r)),
+                              _mm512_abs_pd(_mm512_sub_pd(zi, saved_i)));
+            __mmask8 periodic = _mm512_mask_cmp_pd_mask(
+                active, distance, tolerance, _CMP_LT_OQ);
+            escapes = _mm512_mask_blend_pd(
+                periodic, escapes, _mm512_sub_pd(minus_two, iteration));
+            active &= ~periodic;
+            if (PERIODICITY_SAVE(n)) {
+                saved_r = zr;
+                saved_i = zi;
+            }
+
+            iteration = _mm512_add_pd(iteration, one);
+        }
+
+        double lane_escapes[8], lane_magnitudes[8];
+        _mm512_storeu_pd(lane_escapes, escapes);
+        _mm512_storeu_pd(lane_magnitudes, escape_magnitudes);
+        store_lanes(lane_escapes,
+                    lane_magnitudes,
+                    interior,
+                    lanes,
+                    max_iter,
+                    &values[i],
+                    &magnitudes[i],
+                    iterations);
+    }
+}
+
+// Same as load_lanes(), rounding the points to single precision.
+static void load_float_lanes(const double* re,
+                             const double* im,
+                             unsigned int count,
+                             unsigned int width,
+                             float* lane_re,
+                             float* lane_im) {
+    for (unsigned int lane = 0; lane < width; lane++) {
+        bool used = lane < count;
+        lane_re[lane] = used ? re[lane] : LANE_PADDING;
+        lane_im[lane] = used ? im[lane] : 0;
+    }
+}
+
+static void store_float_lanes(const float* escapes,
+                              const float* escape_magnitudes,
+                              unsigned int interior,
+                              unsigned int count,
+                              int max_iter,
+                              int32_t* values,
+                              float* magnitudes,
+                              uint64_t* iterations) {
+    for (unsigned int lane = 0; lane < count; lane++) {
+        magnitudes[lane] = 0;
+        if (escapes[lane] >= 0) {
+            values[lane] = escapes[lane];
+            magnitudes[lane] = escape_magnitudes[lane];
+            *iterations += values[lane] + 1;
+        } else if (escapes[lane] < -1) {
+            values[lane] = -1;
+            *iterations += -1 - (int32_t)escapes[lane];
+        } else {
+            values[lane] = -1;
+            if (!(interior & (1u << lane)))
+                *iterations += max_iter;
+        }
+    }
+}
+
+__attribute__((target("sse2"))) static void escape_times_sse2_float(
+    bool mandelbrot,
+    double complex julia_c,
+    int max_iter,
+    const double* re,
+    const double* im,
+    unsigned int count,
+    int32_t* values,
+    float* magnitudes,
+    uint64_t* iterations) {
+    const __m128 one = _mm_set1_ps(1);
+    const __m128 four = _mm_set1_ps(4);
+    const __m128 minus_two = _mm_set1_ps(-2);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 tolerance = _mm_set1_ps(PERIODICITY_TOLERANCE_FLOAT);
+
+    for (unsigned int i = 0; i < count; i += 4) {
+        unsigned int lanes = count - i < 4 ? count - i : 4;
+        float lane_re[4], lane_im[4];
+        load_float_lanes(&re[i], &im[i], lanes, 4, lane_re, lane_im);
+
+        __m128 x = _mm_loadu_ps(lane_re);
+        __m128 y = _mm_loadu_ps(lane_im);
+        __m128 zr, zi, cr, ci;
+        __m128 active = _mm_cmpeq_ps(x, x);
+        unsigned int interior = 0;
+
+        if (mandelbrot) {
+            zr = _mm_setzero_ps();
+            zi = _mm_setzero_ps();
+            cr = x;
+            ci = y;
+
+            __m128 dx = _mm_sub_ps(x, _mm_set1_ps(0.25f));
+            __m128 p =
+                _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(y, y)));
+            __m128 bound =
+                _mm_add_ps(_mm_sub_ps(p, _mm_mul_ps(_mm_add_ps(p, p), p)),
+                           _mm_set1_ps(0.25f));
+            __m128 bulb_x = _mm_add_ps(x, one);
+            __m128 bulb = _mm_cmplt_ps(
+                _mm_add_ps(_mm_mul_ps(bulb_x, bulb_x), _mm_mul_ps(y, y)),
+                _mm_set1_ps(0.0625f));
+            __m128 skipped = _mm_or_ps(_mm_cmplt_ps(x, bound), bulb);
+            interior = _mm_movemask_ps(skipped);
+            active = _mm_andnot_ps(skipped, active);
+        } else {
+            zr = x;
+            zi = y;
+            cr = _mm_set1_ps(creal(julia_c));
+            ci = _mm_set1_ps(cimag(julia_c));
+        }
+
+        __m128 escape_magnitudes = _mm_setzero_ps();
+        __m128 escapes = _mm_set1_ps(-1);
+        __m128 iteration = _mm_setzero_ps();
+        __m128 saved_r = zr;
+        __m128 saved_i = zi;
+        for (int n = 0; n < max_iter && _mm_movemask_ps(active); n++) {
+            __m128 zri = _mm_mul_ps(zr, zi);
+            zr = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(zr, zr), _mm_mul_ps(zi, zi)),
+                            cr);
+            zi = _mm_add_ps(_mm_add_ps(zri, zri), ci);
+
+            __m128 magnitude =
+                _mm_add_ps(_mm_mul_ps(zr, zr), _mm_mul_ps(zi, zi));
+            __m128 escaped = _mm_and_ps(_mm_cmpgt_ps(magnitude, four), active);
+            escapes = _mm_or_ps(_mm_andnot_ps(escaped, escapes),
+                                _mm_and_ps(escaped, iteration));
+            escape_magnitudes =
+                _mm_or_ps(_mm_andnot_ps(escaped, escape_magnitudes),
+                          _mm_and_ps(escaped, magnitude));
+            active = _mm_andnot_ps(escaped, active);
+
+            __m128 distance = _mm_add_ps(
+                _mm_andnot_ps(sign, _mm_sub_ps(zr, saved_r)),
+                _mm_andnot_ps(sign, _mm_sub_ps(zi, saved_i)));
+            __m128 periodic =
+                _mm_and_ps(_mm_cmplt_ps(distance, tolerance), active);
+            escapes = _mm_or_ps(
+                _mm_andnot_ps(periodic, escapes),
+                _mm_and_ps(periodic, _mm_sub_ps(minus_two, iteration)));
+            active = _mm_andnot_ps(periodic, active);
+            if (PERIODICITY_SAVE(n)) {
+                saved_r = zr;
+                saved_i = zi;
+            }
+
+            iteration = _mm_add_ps(iteration, one);
+        }
+
+        float lane_escapes[4], lane_magnitudes[4];
+        _mm_storeu_ps(lane_escapes, escapes);
+        _mm_storeu_ps(lane_magnitudes, escape_magnitudes);
+        store_float_lanes(lane_escapes,
+                          lane_magnitudes,
+                          interior,
+                          lanes,
+                          max_iter,
+                          &values[i],
+                          &magnitudes[i],
+                          iterations);
+    }
+}
+
+__attribute__((target("avx2"))) static void escape_times_avx2_float(
+    bool mandelbrot,
+    double complex julia_c,
+    int max_iter,
+    const double* re,
+    const double* im,
+    unsigned int count,
+    int32_t* values,
+    float* magnitudes,
+    uint64_t* iterations) {
+    const __m256 one = _mm256_set1_ps(1);
+    const __m256 four = _mm256_set1_ps(4);
+    const __m256 minus_two = _mm256_set1_ps(-2);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 tolerance = _mm256_set1_ps(PERIODICITY_TOLERANCE_FLOAT);
+
+    for (unsigned int i = 0; i < count; i += 8) {
+        unsigned int lanes = count - i < 8 ? count - i : 8;
+        float lane_re[8], lane_im[8];
+        load_float_lanes(&re[i], &im[i], lanes, 8, lane_re, lane_im);
+
+        __m256 x = _mm256_loadu_ps(lane_re);
+        __m256 y = _mm256_loadu_ps(lane_im);
+        __m256 zr, zi, cr, ci;
+        __m256 active = _mm256_cmp_ps(x, x, _CMP_EQ_OQ);
+        unsigned int interior = 0;
+
+        if (mandelbrot) {
+            zr = _mm256_setzero_ps();
+            zi = _mm256_setzero_ps();
+            cr = x;
+            ci = y;
+
+            __m256 dx = _mm256_sub_ps(x, _mm256_set1_ps(0.25f));
+            __m256 p = _mm256_sqrt_ps(
+                _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(y, y)));
+            __m256 bound = _mm256_add_ps(
+                _mm256_sub_ps(p, _mm256_mul_ps(_mm256_add_ps(p, p), p)),
+                _mm256_set1_ps(0.25f));
+            __m256 bulb_x = _mm256_add_ps(x, one);
+            __m256 bulb = _mm256_cmp_ps(
+                _mm256_add_ps(_mm256_mul_ps(bulb_x, bulb_x),
+                              _mm256_mul_ps(y, y)),
+                _mm256_set1_ps(0.0625f),
+                _CMP_LT_OQ);
+            __m256 skipped =
+                _mm256_or_ps(_mm256_cmp_ps(x, bound, _CMP_LT_OQ), bulb);
+            interior = _mm256_movemask_ps(skipped);
+            active = _mm256_andnot_ps(skipped, active);
+        } else {
+            zr = x;
+            zi = y;
+            cr = _mm256_set1_ps(creal(julia_c));
+            ci = _mm256_set1_ps(cimag(julia_c));
+        }
+
+        __m256 escape_magnitudes = _mm256_setzero_ps();
+        __m256 escapes = _mm256_set1_ps(-1);
+        __m256 iteration = _mm256_setzero_ps();
+        __m256 saved_r = zr;
+        __m256 saved_i = zi;
+        for (int n = 0; n < max_iter && _mm256_movemask_ps(active); n++) {
+            __m256 zri = _mm256_mul_ps(zr, zi);
+            zr = _mm256_add_ps(
+                _mm256_sub_ps(_mm256_mul_ps(zr, zr), _mm256_mul_ps(zi, zi)),
+                cr);
+            zi = _mm256_add_ps(_mm256_add_ps(zri, zri), ci);
+
+            __m256 magnitude =
+                _mm256_add_ps(_mm256_mul_ps(zr, zr), _mm256_mul_ps(zi, zi));
+            __m256 escaped = _mm256_and_ps(
+                _mm256_cmp_ps(magnitude, four, _CMP_GT_OQ), active);
+            escapes = _mm256_blendv_ps(escapes, iteration, escaped);
+            escape_magnitudes =
+                _mm256_blendv_ps(escape_magnitudes, magnitude, escaped);
+            active = _mm256_andnot_ps(escaped, active);
+
+            __m256 distance = _mm256_add_ps(
+                _mm256_andnot_ps(sign, _mm256_sub_ps(zr, saved_r)),
+                _mm256_andnot_ps(sign, _mm256_sub_ps(zi, saved_i)));
+            __m256 periodic = _mm256_and_ps(
+                _mm256_cmp_ps(distance, tolerance, _CMP_LT_OQ), active);
+            escapes = _mm256_blendv_ps(
+                escapes, _mm256_sub_ps(minus_two, iteration), periodic);
+            active = _mm256_andnot_ps(periodic, active);
+            if (PERIODICITY_SAVE(n)) {
+                saved_r = zr;
+                saved_i = zi;
+            }
+
+            iteration = _mm256_add_ps(iteration, one);
+        }
+
+        float lane_escapes[8], lane_magnitudes[8];
+        _mm256_storeu_ps(lane_escapes, escapes);
+        _mm256_storeu_ps(lane_magnitudes, escape_magnitudes);
+        store_float_lanes(lane_escapes,
+                          lane_magnitudes,
+                          interior,
+                          lanes,
+                          max_iter,
+                          &values[i],
+                          &magnitudes[i],
+                          iterations);
+    }
+}
+
+__attribute__((target("avx512f"))) static void escape_times_avx512_float(
+    bool mandelbrot,
+    double complex julia_c,
+    int max_iter,
+    const double* re,
+    const double* im,
+    unsigned int count,
+    int32_t* values,
+    float* magnitudes,
+    uint64_t* iterations) {
+    const __m512 one = _mm512_set1_ps(1);
+    const __m512 four = _mm512_set1_ps(4);
+    const __m512 minus_two = _mm512_set1_ps(-2);
+    const __m512 tolerance = _mm512_set1_ps(PERIODICITY_TOLERANCE_FLOAT);
+
+    for (unsigned int i = 0; i < count; i += 16) {
+        unsigned int lanes = count - i < 16 ? count - i : 16;
+        float lane_re[16], lane_im[16];
+        load_float_lanes(&re[i], &im[i], lanes, 16, lane_re, lane_im);
+
+        __m512 x = _mm512_loadu_ps(lane_re);
+        __m512 y = _mm512_loadu_ps(lane_im);
+        __m512 zr, zi, cr, ci;
+        __mmask16 active = 0xffff;
+        unsigned int interior = 0;
+
+        if (mandelbrot) {
+            zr = _mm512_setzero_ps();
+            zi = _mm512_setzero_ps();
+            cr = x;
+            ci = y;
+
+            __m512 dx = _mm512_sub_ps(x, _mm512_set1_ps(0.25f));
+            __m512 p = _mm512_sqrt_ps(
+                _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(y, y)));
+            __m512 bound = _mm512_add_ps(
+                _mm512_sub_ps(p, _mm512_mul_ps(_mm512_add_ps(p, p), p)),
+                _mm512_set1_ps(0.25f));
+            __m512 bulb_x = _mm512_add_ps(x, one);
+            __mmask16 bulb = _mm512_cmp_ps_mask(
+                _mm512_add_ps(_mm512_mul_ps(bulb_x, bulb_x),
+                              _mm512_mul_ps(y, y)),
+                _mm512_set1_ps(0.0625f),
+                _CMP_LT_OQ);
+            __mmask16 skipped = _mm512_cmp_ps_mask(x, bound, _CMP_LT_OQ) | bulb;
+            interior = skipped;
+            active &= ~skipped;
+        } else {
+            zr = x;
+            zi = y;
+            cr = _mm512_set1_ps(creal(julia_c));
+            ci = _mm512_set1_ps(cimag(julia_c));
+        }
+
+        __m512 escape_magnitudes = _mm512_setzero_ps();
+        __m512 escapes = _mm512_set1_ps(-1);
+        __m512 iteration = _mm512_setzero_ps();
+        __m512 saved_r = zr;
+        __m512 saved_i = zi;
+        for (int n = 0; n < max_iter && active; n++) {
+            __m512 zri = _mm512_mul_ps(zr, zi);
+            zr = _mm512_add_ps(
+                _mm512_sub_ps(_mm512_mul_ps(zr, zr), _mm512_mul_ps(zi, zi)),
+                cr);
+            zi = _mm512_add_ps(_mm512_add_ps(zri, zri), ci);
+
+            __m512 magnitude =
+                _mm512_add_ps(_mm512_mul_ps(zr, zr), _mm512_mul_ps(zi, zi));
+            __mmask16 escaped =
+                _mm512_mask_cmp_ps_mask(active, magnitude, four, _CMP_GT_OQ);
+            escapes = _mm512_mask_blend_ps(escaped, escapes, iteration);
+            escape_magnitudes =
+                _mm512_mask_blend_ps(escaped, escape_magnitudes, magnitude);
+            active &= ~escaped;
+
+            __m512 distance =
+                _mm512_add_ps(_mm512_abs_ps(_mm512_sub_ps(zr, saved_r)),
+                              _mm512_abs_ps(_mm512_sub_ps(zi, saved_i)));
+            __mmask16 periodic = _mm512_mask_cmp_ps_mask(
+                active, distance, tolerance, _CMP_LT_OQ);
+            escapes = _mm512_mask_blend_ps(
+                periodic, escapes, _mm512_sub_ps(minus_two, iteration));
+            active &= ~periodic;
+            if (PERIODICITY_SAVE(n)) {
+                saved_r = zr;
+                saved_i = zi;
+            }
+
+            iteration = _mm512_add_ps(iteration, one);
+        }
+
+        float lane_escapes[16], lane_magnitudes[16];
+        _mm512_storeu_ps(lane_escapes, escapes);
+        _mm512_storeu_ps(lane_magnitudes, escape_magnitudes);
+        store_float_lanes(lane_escapes,
+                          lane_magnitudes,
+                          interior,
+                          lanes,
+                          max_iter,
+                          &values[i],
+                          &magnitudes[i],
+                          iterations);
+    }
+}
+
+#endif
+
+bool kernel_supported(KERNEL_TYPE type) {
+    switch (type) {
+        case KERNEL_AUTO:
+        case KERNEL_SCALAR:
+            return true;
+#ifdef KERNEL_X86
+        case KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+        case KERNEL_AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+KERNEL_TYPE kernel_best(void) {
+    for (KERNEL_TYPE type = KERNEL_AVX512; type > KERNEL_SCALAR; type--) {
+        if (kernel_supported(type))
+            return type;
+    }
+    return KERNEL_SCALAR;
+}
+
+const char* kernel_name(KERNEL_TYPE type) {
+    return kernel_names[type];
+}
+
+int kernel_from_name(const char* name) {
+    for (int type = 0; type < KERNEL_NUM_TYPES; type++) {
+        if (strcmp(kernel_names[type], name) == 0)
+            return type;
+    }
+    return -1;
+}
+
+void kernel_escape_time(KERNEL_TYPE type,
+                        bool mandelbrot,
+                        double complex julia_c,
+                        int max_iter,
+                        const double* re,
+                        const double* im,
+                        unsigned int count,
+                        int32_t* values,
+                        float* magnitudes,
+                        uint64_t* iterations) {
+    if (type == KERNEL_AUTO || !kernel_supported(type))
+        type = kernel_best();
+
+    switch (type) {
+#ifdef KERNEL_X86
+        case KERNEL_SSE2:
+            escape_times_sse2(mandelbrot,
+                              julia_c,
+                              max_iter,
+                              re,
+                              im,
+                              count,
+                              values,
+                              magnitudes,
+                              iterations);
+            return;
+        case KERNEL_AVX2:
+            escape_times_avx2(mandelbrot,
+                              julia_c,
+                              max_iter,
+                              re,
+                              im,
+                              count,
+                              values,
+                              magnitudes,
+                              iterations);
+            return;
+        case KERNEL_AVX512:
+            escape_times_avx512(mandelbrot,
+                                julia_c,
+                                max_iter,
+                                re,
+                                im,
+                                count,
+                                values,
+                                magnitudes,
+                                iterations);
+            return;
+#endif
+        default:
+            escape_times_scalar(mandelbrot,
+                                julia_c,
+                                max_iter,
+                                re,
+                                im,
+                                count,
+                                values,
+                                magnitudes,
+                                iterations);
+    }
+}
+
+void kernel_escape_time_float(KERNEL_TYPE type,
+                              bool mandelbrot,
+                              double complex julia_c,
+                              int max_iter,
+                              const double* re,
+                              const double* im,
+                              unsigned int count,
+                              int32_t* values,
+                              float* magnitudes,
+                              uint64_t* iterations) {
+    if (type == KERNEL_AUTO || !kernel_supported(type))
+        type = kernel_best();
+
+    switch (type) {
+#ifdef KERNEL_X86
+        case KERNEL_SSE2:
+            escape_times_sse2_float(mandelbrot,
+                                    julia_c,
+                                    max_iter,
+                                    re,
+                                    im,
+                                    count,
+                                    values,
+                                    magnitudes,
+                                    iterations);
+            return;
+        case KERNEL_AVX2:
+            escape_times_avx2_float(mandelbrot,
+                                    julia_c,
+                                    max_iter,
+                                    re,
+                                    im,
+                                    count,
+                                    values,
+                                    magnitudes,
+                                    iterations);
+            return;
+        case KERNEL_AVX512:
+            escape_times_avx512_float(mandelbrot,
+                                      julia_c,
+                                      max_iter,
+                                      re,
+                                      im,
+                                      count,
+                                      values,
+                                      magnitudes,
+                                      iterations);
+            return;
+#endif
+        default:
+            escape_times_scalar_float(mandelbrot,
+                                      julia_c,
+                                      max_iter,
+                                      re,
+                                      im,
+                                      count,
+                                      values,
+                                      magnitudes,
+                                      iterations);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <complex.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    KERNEL_AUTO,
+    KERNEL_SCALAR,
+    KERNEL_SSE2,
+    KERNEL_AVX2,
+    KERNEL_AVX512,
+} KERNEL_TYPE;
+
+#define KERNEL_NUM_TYPES (KERNEL_AVX512 + 1)
+
+// Whether the CPU running the program can use `type`.
+bool kernel_supported(KERNEL_TYPE type);
+
+// The widest kernel the CPU supports.
+KERNEL_TYPE kernel_best(void);
+
+const char* kernel_name(KERNEL_TYPE type);
+
+// KERNEL_TYPE named `name`, or -1 if there is none.
+int kernel_from_name(const char* name);
+
+// Iterates z -> z^2 + c for `count` points given as separate real and
+// imaginary parts. For Mandelbrot, each point is c and z starts at 0; for
+// Julia, each point is the initial z and c is `julia_c`. Writes the escape
+// iteration of every point to `values`, or -1 when it never escapes within
+// `max_iter`, and |z|^2 at the escape to `magnitudes`, or 0. Every kernel
+// returns the exact same values.
+void kernel_escape_time(KERNEL_TYPE type,
+                        bool mandelbrot,
+                        double complex julia_c,
+                        int max_iter,
+                        const double* re,
+                        const double* im,
+                        unsigned int count,
+                        int32_t* values,
+                        float* magnitudes,
+                        uint64_t* iterations);
+
+// Same as kernel_escape_time() in single precision, which fits twice the
+// points in each vector. Only suited to views whose pixels are far apart
+// compared to the precision of floats. Every kernel returns the same values
+// as the others, though not the same as kernel_escape_time().
+void kernel_escape_time_float(KERNEL_TYPE type,
+                              bool mandelbrot,
+                              double complex julia_c,
+                              int max_iter,
+                              const double* re,
+                              const double* im,
+                              unsigned int count,
+                              int32_t* values,
+                              float* magnitudes,
+                              uint64_t* iterations);
@@ -1,18 +1,25 @@
 #include <cairo.h>
 #include <complex.h>
 #include <gtk/gtk.h>
-#include <stdint.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include <omp.h>
-
+#include "bench.h"
+#include "bignum.h"
+#include "engine.h"
+#include "export.h"
 #include "overlays.h"
 #include "pixel.h"
+#include "renderer.h"
 #include "state.h"
 #include "window.h"
+#include "worker.h"
 
-#define SIZE 800
+// Initial size of the window, in logical pixels.
+#define WIDTH 800
+#define HEIGHT 800
 #define OVERLAYS_COLOR {0.82, 0.63, 0.00}
 
 #define INITIAL_JULIA false
@@ -22,130 +29,86 @@
 #define INITIAL_COMPLEX_WIDTH 3
 #define INITIAL_SCREEN_CENTER_AS_COMPLEX 0
 
+// Samples taken by the pixels on edges.
+#define INITIAL_ANTIALIAS 16
+
+// Frames render at this fraction of the resolution of the monitor, and get
+// upscaled to fill the window.
+#define INITIAL_RENDER_SCALE 1
+#define MIN_RENDER_SCALE (1.0 / 8)
+
 #define INITIAL_NEWTON_ROOTS 3
 #define INITIAL_NEWTON_ITERATIONS 20
 
+// Newton basins aren't simply connected, so subdividing them may skip
+// details.
+#define INITIAL_MANDELBROT_SUBDIVIDE true
+#define INITIAL_JULIA_SUBDIVIDE true
+#define INITIAL_NEWTON_SUBDIVIDE false
+
 State state;
 
-static double complex newton_f(double complex* roots,
-                               unsigned int num_roots,
-                               double complex x) {
-    double complex result = 1;
-    for (unsigned int i = 0; i < num_roots; i++) {
-        result *= (x - roots[i]);
+static bool* subdivide_config(State* state) {
+    switch (state->fractal_type) {
+        case FRACTAL_MANDELBROT:
+            return &state->fractals_config.mandelbrot.subdivide;
+        case FRACTAL_JULIA:
+            return &state->fractals_config.julia.subdivide;
+        case FRACTAL_NEWTON:
+            return &state->fractals_config.newton.subdivide;
     }
-    return result;
+    return NULL;
 }
 
-static double complex newton_f_prime(double complex* roots,
-                                     unsigned int num_roots,
-                                     double complex x) {
-    double step = 1e-4;
-    return (newton_f(roots, num_roots, x + step) -
-            newton_f(roots, num_roots, x - step)) /
-           (2 * step);
+static EngineParams engine_params_from_state(State* state,
+                                             int width,
+                                             int height) {
+    return (EngineParams){
+        .fractal_type = state->fractal_type,
+        .width = width,
+        .height = height,
+        .center = pixel_get_complex_plane_coordinates(&state->screen_center),
+        .complex_width = state->complex_width,
+        .deep_center = state->deep_center,
+        .max_iter = state->max_iter,
+        .julia_c = pixel_get_complex_plane_coordinates(
+            &state->fractals_config.julia.z0),
+        .newton_roots = state->fractals_config.newton.roots,
+        .newton_num_roots = state->fractals_config.newton.num_roots,
+        .newton_iterations = state->fractals_config.newton.iterations,
+        .subdivide = *subdivide_config(state),
+        .antialias = state->antialias,
+        .palette = state->palette,
+        .color_ramp = state->color_ramp,
+    };
 }
 
-static int newton_threshold(double complex z0, State* state) {
-    double complex z = z0;
-
-    for (int i = 0; i < state->fractals_config.newton.iterations; i++) {
-        z -= newton_f(state->fractals_config.newton.roots,
-                      state->fractals_config.newton.num_roots,
-                      z) /
-             newton_f_prime(state->fractals_config.newton.roots,
-                            state->fractals_config.newton.num_roots,
-                            z);
-    }
-
-    int closest_root_index = 0;
-    double closest_distance = cabs(z - state->fractals_config.newton.roots[0]);
-    for (int root_index = 1;
-         root_index < sizeof(state->fractals_config.newton.roots);
-         root_index++) {
-        double distance =
-            cabs(z - state->fractals_config.newton.roots[root_index]);
-        if (distance < closest_distance) {
-            closest_distance = distance;
-            closest_root_index = root_index;
-        }
-    }
-
-    return closest_root_index;
+// Size of the frames rendered for the window, in pixels.
+static void render_size(unsigned int* width, unsigned int* height) {
+    double density = state.window->scale * state.render_scale;
+    *width = fmax(round(state.window->width * density), 1);
+    *height = fmax(round(state.window->height * density), 1);
 }
 
-static int8_t diverging_threshold(double complex initial_z,
-                                  double complex c,
-                                  int max_iter) {
-    if (state.fractal_type == FRACTAL_MANDELBROT) {
-        double p =
-            csqrt((creal(c) - 0.25) * (creal(c) - 0.25) + cimag(c) * cimag(c));
-        if (creal(c) < p - 2 * p * p + 0.25) {
-            return -1;
-        }
-    }
-
-    double complex z = initial_z;
-    for (int i = 0; i < max_iter; i++) {
-        z = z * z + c;
-        if (creal(z) * creal(z) + cimag(z) * cimag(z) > 4) {
-            return i;
-        }
-    }
-    return -1;
+static void on_frame(gpointer _user_data) {
+    if (state.window->drawing_area != NULL)
+        gtk_widget_queue_draw(GTK_WIDGET(state.window->drawing_area));
 }
 
-static void set_pixel_color_rgb(guchar* pixels,
-                                int x,
-                                int y,
-                                int r,
-                                int g,
-                                int b) {
-    pixels[(y * SIZE + x) * 3] = r;
-    pixels[(y * SIZE + x) * 3 + 1] = g;
-    pixels[(y * SIZE + x) * 3 + 2] = b;
+static void request_render(void) {
+    unsigned int width, height;
+    render_size(&width, &height);
+    EngineParams params = engine_params_from_state(&state, width, height);
+    renderer_submit(state.renderer, &params);
 }
 
-void color_point(Pixel* pixel) {
-    double complex complex_point = pixel_get_complex_plane_coordinates(pixel);
-    double complex screen_point = pixel_get_screen_coordinates(pixel);
-
-    int8_t threshold;
-
-    if (state.fractal_type == FRACTAL_JULIA) {
-        threshold = diverging_threshold(complex_point,
-                                        pixel_get_complex_plane_coordinates(
-                                            &state.fractals_config.julia.z0),
-                                        state.max_iter);
-    } else {
-        threshold = diverging_threshold(0, complex_point, state.max_iter);
-    }
-
-    double color;
-    if (threshold == -1) {
-        color = 0;
-    } else {
-        color = threshold * 255.0 / 40;
-        if (color > 255)
-            color = 255;
-    }
-
-    set_pixel_color_rgb(state.pixels,
-                        creal(screen_point),
-                        cimag(screen_point),
-                        color,
-                        color,
-                        color);
-
-    int mirrored_y =
-        2 * cimag(pixel_get_complex_plane_coordinates(&state.screen_center)) -
-        cimag(screen_point);
-
-    if (state.fractal_type == FRACTAL_MANDELBROT &&
-        mirrored_y < state.window->size && mirrored_y >= 0) {
-        set_pixel_color_rgb(
-            state.pixels, creal(screen_point), mirrored_y, color, color, color);
-    }
+// For changes that keep coming while the user drags or holds a key, which
+// render at reduced quality until the input goes idle.
+static void request_interactive_render(void) {
+    unsigned int width, height;
+    render_size(&width, &height);
+    EngineParams params = engine_params_from_state(&state, width, height);
+    renderer_submit_interactive(state.renderer, &params);
 }
 
 static void draw(GtkDrawingArea* drawing_area,
@@ -153,85 +116,75 @@ static void draw(GtkDrawingArea* drawing_area,
                  int width,
                  int height,
                  gpointer _user_data) {
-    double complex screen_center_in_complex_plane =
-        pixel_get_complex_plane_coordinates(&state.screen_center);
-
-    if (state.fractal_type == FRACTAL_MANDELBROT) {
-        if (cimag(screen_center_in_complex_plane) > height / 2.0) {
-#pragma omp parallel for
-            for (int x = 0; x < width; x++) {
-                for (int y = 0; y < cimag(screen_center_in_complex_plane);
-                     y++) {
-                    Pixel pixel =
-                        pixel_new_from_screen_coordinates(&state, x + y * I);
-                    color_point(&pixel);
-                }
-            }
+    renderer_draw(state.renderer, cr, width, height);
 
-        } else {
-#pragma omp parallel for
-            for (int x = 0; x < width; x++) {
-                for (int y = cimag(screen_center_in_complex_plane); y < height;
-                     y++) {
-                    Pixel pixel =
-                        pixel_new_from_screen_coordinates(&state, x + y * I);
-                    color_point(&pixel);
-                }
-            }
-        }
+    if (state.show_overlays)
+        overlay_layer_paint(state.overlay_layer, cr, &state);
+}
 
-    } else if (state.fractal_type == FRACTAL_JULIA) {
-#pragma omp parallel for
-        for (int x = 0; x < width; x++) {
-            for (int y = 0; y < height; y++) {
-                Pixel pixel =
-                    pixel_new_from_screen_coordinates(&state, x + y * I);
-                color_point(&pixel);
-            }
-        }
-    } else if (state.fractal_type == FRACTAL_NEWTON) {
-#pragma omp parallel for
-        for (int x = 0; x < width; x++) {
-            for (int y = 0; y < height; y++) {
-                Pixel pixel =
-                    pixel_new_from_screen_coordinates(&state, x + y * I);
-                int closest_root_index = newton_threshold(
-                    pixel_get_complex_plane_coordinates(&pixel), &state);
-                double complex screen_point =
-                    pixel_get_screen_coordinates(&pixel);
-
-                set_pixel_color_rgb(state.pixels,
-                                    creal(screen_point),
-                                    cimag(screen_point),
-                                    closest_root_index * 255.0 /
-                                        state.fractals_config.newton.num_roots,
-                                    closest_root_index * 255.0 /
-                                        state.fractals_config.newton.num_roots,
-                                    closest_root_index * 255.0 /
-                                        state.fractals_config.newton.num_roots);
-            }
+// Keeps the complex coordinates of `pixel`, for the view changed the way it
+// maps to the screen.
+static void forget_screen_coordinates(Pixel* pixel) {
+    pixel_get_complex_plane_coordinates(pixel);
+    pixel->_screen_coordinates_cached = false;
+}
+
+// Resizing keeps the zoom level, showing more or less of the plane around
+// the same center, so that the previous frame reprojects exactly.
+static void on_resize(unsigned int previous_width) {
+    state.complex_width *= (double)state.window->width / previous_width;
+    forget_screen_coordinates(&state.screen_center);
+    forget_screen_coordinates(&state.fractals_config.julia.z0);
+    request_interactive_render();
+}
+
+// Moves the view to `offset` rendered pixels from (`center`,
+// `deep_center`), rounded to whole pixels so that the renderer can reuse the
+// previous frame.
+static void move_view(Pixel center,
+                      BigComplex deep_center,
+                      double complex offset) {
+    unsigned int width, height;
+    render_size(&width, &height);
+    double step = state.complex_width / width;
+    double complex value =
+        (round(creal(offset)) + round(cimag(offset)) * I) * step;
+
+    state.screen_center =
+        pixel_add_value(&center, value, COORDINATES_TYPE_COMPLEX_PLANE);
+    state.deep_center = bigcomplex_add_complex(&deep_center, value);
+    state.fractals_config.julia.z0._screen_coordinates_cached = false;
+}
+
+static unsigned int closest_root(double complex position) {
+    NewtonConfig* newton = &state.fractals_config.newton;
+    double min_distance = INFINITY;
+    unsigned int min_index = 0;
+    for (unsigned int i = 0; i < newton->num_roots; i++) {
+        double distance = cabs(position - newton->roots[i]);
+        if (distance < min_distance) {
+            min_distance = distance;
+            min_index = i;
         }
     }
+    return min_index;
+}
 
-    // GdkTexture* texture = gdk_memory_texture_new(width, height,
-    // GDK_MEMORY_G8, state.pixels, width);
-
-    GdkPixbuf* pixbuf = gdk_pixbuf_new_from_data(state.pixels,
-                                                 GDK_COLORSPACE_RGB,
-                                                 FALSE,
-                                                 8,
-                                                 width,
-                                                 height,
-                                                 width * 3,
-                                                 NULL,
-                                                 NULL);
+static void add_root(double complex position) {
+    NewtonConfig* newton = &state.fractals_config.newton;
+    newton->roots = realloc(newton->roots,
+                            (newton->num_roots + 1) * sizeof(double complex));
+    newton->roots[newton->num_roots++] = position;
+}
 
-    gdk_cairo_set_source_pixbuf(cr, pixbuf, 0, 0);
-    cairo_paint(cr);
-    g_object_unref(pixbuf);
+// Removes the root closest to `position`, keeping at least one.
+static void remove_root(double complex position) {
+    NewtonConfig* newton = &state.fractals_config.newton;
+    if (newton->num_roots <= 1)
+        return;
 
-    if (state.show_overlays)
-        draw_overlays(cr, &state);
+    unsigned int index = closest_root(position);
+    newton->roots[index] = newton->roots[--newton->num_roots];
 }
 
 static gboolean on_key_press(GtkEventControllerKey* controller,
@@ -239,52 +192,46 @@ static gboolean on_key_press(GtkEventControllerKey* controller,
                              guint keycode,
                              GdkModifierType modifier) {
     GtkDrawingArea* drawing_area = state.window->drawing_area;
+    unsigned int width, height;
+    render_size(&width, &height);
 
     switch (keyval) {
         case GDK_KEY_Up:
-            state.screen_center =
-                pixel_add_value(&state.screen_center,
-                                0.1 * state.complex_width * I,
-                                COORDINATES_TYPE_COMPLEX_PLANE);
-            state.fractals_config.julia.z0._screen_coordinates_cached = false;
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            move_view(state.screen_center,
+                      state.deep_center,
+                      0.1 * height * I);
+            request_render();
             break;
         case GDK_KEY_Down:
-            state.screen_center =
-                pixel_add_value(&state.screen_center,
-                                -0.1 * state.complex_width * I,
-                                COORDINATES_TYPE_COMPLEX_PLANE);
-            state.fractals_config.julia.z0._screen_coordinates_cached = false;
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            move_view(state.screen_center,
+                      state.deep_center,
+                      -0.1 * height * I);
+            request_render();
             break;
         case GDK_KEY_Right:
-            state.screen_center =
-                pixel_add_value(&state.screen_center,
-                                0.1 * state.complex_width,
-                                COORDINATES_TYPE_COMPLEX_PLANE);
-            state.fractals_config.julia.z0._screen_coordinates_cached = false;
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            move_view(state.screen_center,
+                      state.deep_center,
+                      0.1 * width);
+            request_render();
             break;
         case GDK_KEY_Left:
-            state.screen_center =
-                pixel_add_value(&state.screen_center,
-                                -0.1 * state.complex_width,
-                                COORDINATES_TYPE_COMPLEX_PLANE);
-            state.fractals_config.julia.z0._screen_coordinates_cached = false;
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            move_view(state.screen_center,
+                      state.deep_center,
+                      -0.1 * width);
+            request_render();
             break;
         case GDK_KEY_plus:
         case GDK_KEY_equal:
             state.complex_width *= 0.9;
             state.max_iter += 3;
             state.fractals_config.julia.z0._screen_coordinates_cached = false;
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            request_render();
             break;
         case GDK_KEY_minus:
             state.complex_width *= 1.1;
             state.max_iter -= 3;
             state.fractals_config.julia.z0._screen_coordinates_cached = false;
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            request_render();
             break;
         case GDK_KEY_q:
             gtk_window_destroy(GTK_WINDOW(state.window->app_window));
@@ -297,57 +244,76 @@ static gboolean on_key_press(GtkEventControllerKey* controller,
             } else if (state.fractal_type == FRACTAL_NEWTON) {
                 state.fractal_type = FRACTAL_MANDELBROT;
             }
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            request_render();
             break;
         case GDK_KEY_h:
             state.screen_center =
                 pixel_new_from_complex_plane_coordinates(&state, 0);
+            state.deep_center = bigcomplex_from_complex(0);
             state.complex_width = 3;
             state.max_iter = INITIAL_MAX_ITER;
             state.fractals_config.julia.z0 =
                 pixel_new_from_complex_plane_coordinates(&state,
                                                          INITIAL_JULIA_Z0);
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            request_render();
             break;
         case GDK_KEY_w:
             state.fractals_config.julia.z0 =
                 pixel_add_value(&state.fractals_config.julia.z0,
                                 0.1 * I,
                                 COORDINATES_TYPE_COMPLEX_PLANE);
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            request_interactive_render();
             break;
         case GDK_KEY_s:
             state.fractals_config.julia.z0 =
                 pixel_add_value(&state.fractals_config.julia.z0,
                                 -0.1 * I,
                                 COORDINATES_TYPE_COMPLEX_PLANE);
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            request_interactive_render();
             break;
         case GDK_KEY_a:
             state.fractals_config.julia.z0 =
                 pixel_add_value(&state.fractals_config.julia.z0,
                                 -0.1,
                                 COORDINATES_TYPE_COMPLEX_PLANE);
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            request_interactive_render();
             break;
         case GDK_KEY_d:
             state.fractals_config.julia.z0 =
                 pixel_add_value(&state.fractals_config.julia.z0,
                                 +0.1,
                                 COORDINATES_TYPE_COMPLEX_PLANE);
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            request_interactive_render();
+            break;
+        case GDK_KEY_m:
+            *subdivide_config(&state) = !*subdivide_config(&state);
+            request_render();
             break;
         case GDK_KEY_o:
             state.show_overlays = !state.show_overlays;
             gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
             break;
+        case GDK_KEY_r:
+            if (state.fractal_type == FRACTAL_NEWTON) {
+                add_root(pixel_get_complex_plane_coordinates(
+                    &state.screen_center));
+                request_render();
+            }
+            break;
+        case GDK_KEY_R:
+            if (state.fractal_type == FRACTAL_NEWTON) {
+                remove_root(pixel_get_complex_plane_coordinates(
+                    &state.screen_center));
+                request_render();
+            }
+            break;
         case GDK_KEY_i:
             if (state.fractal_type == FRACTAL_NEWTON) {
                 state.fractals_config.newton.iterations += 1;
             } else {
                 state.max_iter += 10;
             }
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            request_render();
             break;
         case GDK_KEY_I:
             if (state.fractal_type == FRACTAL_NEWTON) {
@@ -355,13 +321,49 @@ static gboolean on_key_press(GtkEventControllerKey* controller,
             } else {
                 state.max_iter -= 10;
             }
-            gtk_widget_queue_draw(GTK_WIDGET(drawing_area));
+            request_render();
+            break;
+        case GDK_KEY_p:
+            state.palette = (state.palette + 1) % PALETTE_NUM_TYPES;
+            request_render();
+            break;
+        case GDK_KEY_c:
+            state.color_ramp *= 2;
+            request_render();
+            break;
+        case GDK_KEY_C:
+            if (state.color_ramp > 1)
+                state.color_ramp /= 2;
+            request_render();
+            break;
+        case GDK_KEY_v:
+            if (state.render_scale > MIN_RENDER_SCALE)
+                state.render_scale /= 2;
+            request_render();
+            break;
+        case GDK_KEY_V:
+            if (state.render_scale < 1)
+                state.render_scale *= 2;
+            request_render();
+            break;
+        case GDK_KEY_x:
+            if (state.antialias < ENGINE_MAX_ANTIALIAS)
+                state.antialias *= 2;
+            request_render();
+            break;
+        case GDK_KEY_X:
+            if (state.antialias > 1)
+                state.antialias /= 2;
+            request_render();
             break;
     }
 
     return TRUE;
 }
 
+bool dragging_view;
+Pixel initial_screen_center;
+BigComplex initial_deep_center;
 Pixel initial_julia_z0;
 unsigned int initial_root_index;
 Pixel initial_root_position;
@@ -370,26 +372,20 @@ void on_drag_start(GtkGestureDrag* gesture,
                    gdouble start_x,
                    gdouble start_y,
                    gpointer _user_data) {
-    if (state.fractal_type == FRACTAL_JULIA) {
+    dragging_view = state.fractal_type == FRACTAL_MANDELBROT ||
+                    gtk_gesture_single_get_current_button(GTK_GESTURE_SINGLE(
+                        gesture)) == GDK_BUTTON_SECONDARY;
+
+    if (dragging_view) {
+        initial_screen_center = state.screen_center;
+        initial_deep_center = state.deep_center;
+    } else if (state.fractal_type == FRACTAL_JULIA) {
         initial_julia_z0 = state.fractals_config.julia.z0;
     } else if (state.fractal_type == FRACTAL_NEWTON) {
         Pixel mouse_position =
             pixel_new_from_screen_coordinates(&state, start_x + start_y * I);
-        double complex mouse_position_complex =
-            pixel_get_complex_plane_coordinates(&mouse_position);
-        double min_distance = INFINITY;
-        unsigned int min_index = 0;
-        for (unsigned int i = 0; i < state.fractals_config.newton.num_roots;
-             i++) {
-            double distance = cabs(mouse_position_complex -
-                                   state.fractals_config.newton.roots[i]);
-            if (distance < min_distance) {
-                min_distance = distance;
-                min_index = i;
-            }
-        }
-
-        initial_root_index = min_index;
+        initial_root_index = closest_root(
+            pixel_get_complex_plane_coordinates(&mouse_position));
         initial_root_position = pixel_new_from_complex_plane_coordinates(
             &state, state.fractals_config.newton.roots[initial_root_index]);
     }
@@ -399,13 +395,21 @@ void on_drag_update(GtkGestureDrag* gesture,
                     gdouble offset_x,
                     gdouble offset_y,
                     gpointer _user_data) {
-    if (state.fractal_type == FRACTAL_JULIA) {
+    if (dragging_view) {
+        unsigned int width, height;
+        render_size(&width, &height);
+        double density = (double)width / state.window->width;
+        move_view(initial_screen_center,
+                  initial_deep_center,
+                  (-offset_x + offset_y * I) * density);
+        request_render();
+    } else if (state.fractal_type == FRACTAL_JULIA) {
         Pixel new_mouse_position = pixel_add_value(&initial_julia_z0,
                                                    offset_x + offset_y * I,
                                                    COORDINATES_TYPE_SCREEN);
 
         state.fractals_config.julia.z0 = new_mouse_position;
-        gtk_widget_queue_draw(GTK_WIDGET(state.window->drawing_area));
+        request_interactive_render();
     } else if (state.fractal_type == FRACTAL_NEWTON) {
         Pixel new_mouse_position = pixel_add_value(&initial_root_position,
                                                    offset_x + offset_y * I,
@@ -413,11 +417,21 @@ void on_drag_update(GtkGestureDrag* gesture,
 
         state.fractals_config.newton.roots[initial_root_index] =
             pixel_get_complex_plane_coordinates(&new_mouse_position);
-        gtk_widget_queue_draw(GTK_WIDGET(state.window->drawing_area));
+        request_interactive_render();
     }
 }
 
 int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        return bench_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "--export") == 0) {
+        return export_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "--worker") == 0) {
+        return worker_main(argc - 1, argv + 1);
+    }
+
     double complex* newton_roots =
         malloc(INITIAL_NEWTON_ROOTS * sizeof(double complex));
     for (int i = 0; i < INITIAL_NEWTON_ROOTS; i++) {
@@ -425,44 +439,56 @@ int main(int argc, char* argv[]) {
     }
 
     state = (State){
-        .pixels = malloc(SIZE * SIZE * 3),
         .window = window_new("Fractals",
-                             SIZE,
-                             state.pixels,
+                             WIDTH,
+                             HEIGHT,
                              draw,
+                             on_resize,
                              on_key_press,
                              on_drag_start,
                              on_drag_update),
 
         .fractal_type = FRACTAL_NEWTON,
         .fractals_config =
-            {.mandelbrot = {},
+            {.mandelbrot = {.subdivide = INITIAL_MANDELBROT_SUBDIVIDE},
              .julia =
                  {
                      .z0 = pixel_new_from_complex_plane_coordinates(
                          &state, INITIAL_JULIA_Z0),
+                     .subdivide = INITIAL_JULIA_SUBDIVIDE,
                  },
              .newton = {.roots = newton_roots,
                         .num_roots = INITIAL_NEWTON_ROOTS,
-                        .iterations = INITIAL_NEWTON_ITERATIONS}},
+                        .iterations = INITIAL_NEWTON_ITERATIONS,
+                        .subdivide = INITIAL_NEWTON_SUBDIVIDE}},
 
         .max_iter = INITIAL_MAX_ITER,
+        .color_ramp = ENGINE_DEFAULT_COLOR_RAMP,
+        .antialias = INITIAL_ANTIALIAS,
+        .render_scale = INITIAL_RENDER_SCALE,
 
         .complex_width = INITIAL_COMPLEX_WIDTH,
         .screen_center = pixel_new_from_complex_plane_coordinates(
             &state, INITIAL_SCREEN_CENTER_AS_COMPLEX),
+        .deep_center =
+            bigcomplex_from_complex(INITIAL_SCREEN_CENTER_AS_COMPLEX),
 
         .show_overlays = true,
         .overlays_color = OVERLAYS_COLOR,
+        .overlay_layer = overlay_layer_new(),
         .tick_step = 1,
     };
 
+    state.renderer = renderer_new(WIDTH, HEIGHT, on_frame, NULL);
+    request_render();
+
     int status = window_present(state.window);
 
+    renderer_free(state.renderer);
     window_free(state.window);
+    overlay_layer_free(state.overlay_layer);
 
-    g_free(state.pixels);
-    g_free(newton_roots);
+    free(state.fractals_config.newton.roots);
 
     return status;
 }
@@ -0,0 +1,296 @@
+#include "newton.h"
+#include <complex.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Uniform grid over the bounding box of the roots, with about one root per
+// cell. Cell (x, y) holds `cell_roots[cell_start[y * columns + x]]` up to
+// the start of the next cell.
+struct NewtonIndex {
+    double complex* roots;
+    unsigned int num_roots;
+
+    // The roots again, split into real and imaginary parts for the sweeps.
+    double* re;
+    double* im;
+
+    double left;
+    double bottom;
+    double cell_size;
+    unsigned int columns;
+    unsigned int rows;
+    unsigned int* cell_start;
+    unsigned int* cell_roots;
+};
+
+NewtonIndex* newton_index_new(void) {
+    return calloc(1, sizeof(NewtonIndex));
+}
+
+static unsigned int cell_of(const NewtonIndex* index, double re, double im) {
+    unsigned int x = (re - index->left) / index->cell_size;
+    unsigned int y = (im - index->bottom) / index->cell_size;
+    if (x >= index->columns)
+        x = index->columns - 1;
+    if (y >= index->rows)
+        y = index->rows - 1;
+    return y * index->columns + x;
+}
+
+static void build_index(NewtonIndex* index) {
+    unsigned int num_roots = index->num_roots;
+    double left = INFINITY, right = -INFINITY;
+    double bottom = INFINITY, top = -INFINITY;
+    for (unsigned int i = 0; i < num_roots; i++) {
+        index->re[i] = creal(index->roots[i]);
+        index->im[i] = cimag(index->roots[i]);
+        left = fmin(left, index->re[i]);
+        right = fmax(right, index->re[i]);
+        bottom = fmin(bottom, index->im[i]);
+        top = fmax(top, index->im[i]);
+    }
+
+    // Roots lined up on an axis still get about one per cell.
+    double width = right - left;
+    double height = top - bottom;
+    double cell_size = fmax(sqrt(width * height / num_roots),
+                            fmax(width, height) / num_roots);
+    if (cell_size == 0)
+        cell_size = 1;
+
+    index->left = left;
+    index->bottom = bottom;
+    index->cell_size = cell_size;
+    index->columns = width / cell_size + 1;
+    index->rows = height / cell_size + 1;
+
+    unsigned int num_cells = index->columns * index->rows;
+    index->cell_start = realloc(index->cell_start,
+                                (num_cells + 1) * sizeof(unsigned int));
+    memset(index->cell_start, 0, (num_cells + 1) * sizeof(unsigned int));
+
+    // Counting sort of the roots by cell.
+    for (unsigned int i = 0; i < num_roots; i++) {
+        index->cell_start[cell_of(index, index->re[i], index->im[i]) + 1]++;
+    }
+    for (unsigned int cell = 0; cell < num_cells; cell++) {
+        index->cell_start[cell + 1] += index->cell_start[cell];
+    }
+
+    unsigned int* next = malloc(num_cells * sizeof(unsigned int));
+    memcpy(next, index->cell_start, num_cells * sizeof(unsigned int));
+    for (unsigned int i = 0; i < num_roots; i++) {
+        index->cell_roots[next[cell_of(index, index->re[i], index->im[i])]++] =
+            i;
+    }
+    free(next);
+}
+
+void newton_index_update(NewtonIndex* index, const EngineParams* params) {
+    size_t size = params->newton_num_roots * sizeof(double complex);
+    if (index->roots != NULL &&
+        index->num_roots == params->newton_num_roots &&
+        memcmp(index->roots, params->newton_roots, size) == 0)
+        return;
+
+    index->num_roots = params->newton_num_roots;
+    index->roots = realloc(index->roots, size);
+    memcpy(index->roots, params->newton_roots, size);
+    index->re = realloc(index->re, index->num_roots * sizeof(double));
+    index->im = realloc(index->im, index->num_roots * sizeof(double));
+    index->cell_roots =
+        realloc(index->cell_roots, index->num_roots * sizeof(unsigned int));
+
+    build_index(index);
+}
+
+void newton_index_free(NewtonIndex* index) {
+    free(index->cell_roots);
+    free(index->cell_start);
+    free(index->im);
+    free(index->re);
+    free(index->roots);
+    free(index);
+}
+
+// Distance squared from (`re`, `im`) to root `i`.
+static double distance_to(const NewtonIndex* index,
+                          unsigned int i,
+                          double re,
+                          double im) {
+    double dr = re - index->re[i];
+    double di = im - index->im[i];
+    return dr * dr + di * di;
+}
+
+// A root within NEWTON_TOLERANCE of (`re`, `im`), or -1 if there is none.
+static int find_root(const NewtonIndex* index, double re, double im) {
+    double x0 = (re - NEWTON_TOLERANCE - index->left) / index->cell_size;
+    double x1 = (re + NEWTON_TOLERANCE - index->left) / index->cell_size;
+    double y0 = (im - NEWTON_TOLERANCE - index->bottom) / index->cell_size;
+    double y1 = (im + NEWTON_TOLERANCE - index->bottom) / index->cell_size;
+
+    // Also rules out NaNs.
+    if (!(x1 >= 0 && x0 < index->columns && y1 >= 0 && y0 < index->rows))
+        return -1;
+
+    unsigned int first_x = fmax(x0, 0);
+    unsigned int last_x = fmin(x1, index->columns - 1);
+    unsigned int first_y = fmax(y0, 0);
+    unsigned int last_y = fmin(y1, index->rows - 1);
+
+    for (unsigned int y = first_y; y <= last_y; y++) {
+        for (unsigned int x = first_x; x <= last_x; x++) {
+            unsigned int cell = y * index->columns + x;
+            for (unsigned int j = index->cell_start[cell];
+                 j < index->cell_start[cell + 1];
+                 j++) {
+                unsigned int i = index->cell_roots[j];
+                if (distance_to(index, i, re, im) <
+                    NEWTON_TOLERANCE * NEWTON_TOLERANCE)
+                    return i;
+            }
+        }
+    }
+
+    return -1;
+}
+
+// The root closest to (`re`, `im`), searching rings of cells further and
+// further away from the closest cell until the closest root found so far
+// is nearer than any cell left.
+static unsigned int closest_root(const NewtonIndex* index,
+                                 double re,
+                                 double im) {
+    if (isnan(re) || isnan(im))
+        return 0;
+
+    int cx = fmin(fmax((re - index->left) / index->cell_size, 0),
+                  index->columns - 1);
+    int cy = fmin(fmax((im - index->bottom) / index->cell_size, 0),
+                  index->rows - 1);
+    int columns = index->columns;
+    int rows = index->rows;
+
+    unsigned int closest = 0;
+    double closest_distance = INFINITY;
+    for (int ring = 0;; ring++) {
+        for (int y = cy - ring; y <= cy + ring; y++) {
+            if (y < 0 || y >= rows)
+                continue;
+
+            // Only the first and last rows of the ring are whole.
+            int step = y == cy - ring || y == cy + ring ? 1 : 2 * ring;
+            for (int x = cx - ring; x <= cx + ring; x += step) {
+                if (x < 0 || x >= columns)
+                    continue;
+
+                unsigned int cell = y * columns + x;
+                for (unsigned int j = index->cell_start[cell];
+                     j < index->cell_start[cell + 1];
+                     j++) {
+                    unsigned int i = index->cell_roots[j];
+                    double distance = distance_to(index, i, re, im);
+                    if (distance < closest_distance ||
+                        (distance == closest_distance && i < closest)) {
+                        closest_distance = distance;
+                        closest = i;
+                    }
+                }
+            }
+        }
+
+        // Distance to the nearest cell not searched yet, on the sides where
+        // the grid goes on.
+        double reach = INFINITY;
+        if (cx - ring > 0)
+            reach = fmin(
+                reach, re - (index->left + (cx - ring) * index->cell_size));
+        if (cx + ring < columns - 1)
+            reach = fmin(reach,
+                         index->left + (cx + ring + 1) * index->cell_size - re);
+        if (cy - ring > 0)
+            reach = fmin(
+                reach, im - (index->bottom + (cy - ring) * index->cell_size));
+        if (cy + ring < rows - 1)
+            reach = fmin(
+                reach, index->bottom + (cy + ring + 1) * index->cell_size - im);
+
+        if (closest_distance <= reach * reach)
+            return closest;
+    }
+}
+
+// Iterates z -> z - f(z) / f'(z) for f the polynomial with the roots of
+// `index`, using f'(z) / f(z) = sum of 1 / (z - root), which needs no
+// product over the roots and no finite difference. The points still
+// iterating are packed at the start of `zr` and `zi`, so that the sweep
+// over the roots runs over contiguous lanes.
+void newton_sample_points(const EngineParams* params,
+                          const NewtonIndex* index,
+                          const double* re,
+                          const double* im,
+                          unsigned int count,
+                          int32_t* values,
+                          float* magnitudes,
+                          uint64_t* iterations) {
+    unsigned int num_roots = index->num_roots;
+    double zr[ENGINE_BATCH_SIZE], zi[ENGINE_BATCH_SIZE];
+    unsigned int lanes[ENGINE_BATCH_SIZE];
+    for (unsigned int j = 0; j < count; j++) {
+        zr[j] = re[j];
+        zi[j] = im[j];
+        lanes[j] = j;
+    }
+
+    unsigned int active = count;
+    unsigned int i = 0;
+    for (; i < params->newton_iterations && active > 0; i++) {
+        unsigned int remaining = 0;
+        for (unsigned int j = 0; j < active; j++) {
+            int root = find_root(index, zr[j], zi[j]);
+            if (root >= 0) {
+                values[lanes[j]] = i * num_roots + root;
+                magnitudes[lanes[j]] = distance_to(index, root, zr[j], zi[j]);
+                *iterations += i;
+                continue;
+            }
+            zr[remaining] = zr[j];
+            zi[remaining] = zi[j];
+            lanes[remaining] = lanes[j];
+            remaining++;
+        }
+        active = remaining;
+
+        double sum_re[ENGINE_BATCH_SIZE] = {0};
+        double sum_im[ENGINE_BATCH_SIZE] = {0};
+        for (unsigned int root = 0; root < num_roots; root++) {
+            double root_re = index->re[root];
+            double root_im = index->im[root];
+            for (unsigned int j = 0; j < active; j++) {
+                double dr = zr[j] - root_re;
+                double di = zi[j] - root_im;
+                double inverse = 1 / (dr * dr + di * di);
+                sum_re[j] += dr * inverse;
+                sum_im[j] -= di * inverse;
+            }
+        }
+
+        for (unsigned int j = 0; j < active; j++) {
+            double inverse =
+                1 / (sum_re[j] * sum_re[j] + sum_im[j] * sum_im[j]);
+            zr[j] -= sum_re[j] * inverse;
+            zi[j] += sum_im[j] * inverse;
+        }
+    }
+
+    // Points that haven't converged yet go to the closest root.
+    for (unsigned int j = 0; j < active; j++) {
+        unsigned int root = closest_root(index, zr[j], zi[j]);
+        values[lanes[j]] = i * num_roots + root;
+        magnitudes[lanes[j]] = distance_to(index, root, zr[j], zi[j]);
+        *iterations += i;
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "engine.h"
+
+// Newton iterations stop once z is this close to a root.
+#define NEWTON_TOLERANCE 1e-6
+
+NewtonIndex* newton_index_new(void);
+
+// Rebuilds `index` when `params` has different roots than it was built for.
+void newton_index_update(NewtonIndex* index, const EngineParams* params);
+
+void newton_index_free(NewtonIndex* index);
+
+// Same as engine_sample_points() for Newton fractals, whose magnitudes are
+// the squared distances to the root reached. The points of a batch step
+// together, sweeping the roots once per step for all of them, and the roots
+// close to each point are found through `index` rather than by measuring
+// the distance to all of them.
+void newton_sample_points(const EngineParams* params,
+                          const NewtonIndex* index,
+                          const double* re,
+                          const double* im,
+                          unsigned int count,
+                          int32_t* values,
+                          float* magnitudes,
+                          uint64_t* iterations);
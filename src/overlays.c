@@ -1,7 +1,35 @@
 #include "overlays.h"
+#include <stdlib.h>
+#include <string.h>
+
 #include "cairo.h"
 #include "pixel.h"
 
+// Newton roots listed by the labels, past which only their count is shown.
+#define MAX_ROOT_LABELS 8
+
+// Everything the overlays show. Layers are drawn again only when it changes.
+typedef struct {
+    FRACTAL_TYPE fractal_type;
+    unsigned int width;
+    unsigned int height;
+    unsigned int scale;
+    double complex center;
+    double complex_width;
+    int max_iter;
+    double complex julia_z0;
+    unsigned int newton_iterations;
+    unsigned int newton_num_roots;
+    float color[3];
+} OverlayKey;
+
+struct OverlayLayer {
+    cairo_surface_t* surface;
+    bool drawn;
+    OverlayKey key;
+    double complex* newton_roots;
+};
+
 static void set_overlay_colors(cairo_t* cr, State* state) {
     cairo_set_source_rgb(cr,
                          state->overlays_color[0],
@@ -17,9 +45,9 @@ void draw_axes(cairo_t* cr, State* state) {
     double complex screen_origin = pixel_get_screen_coordinates(&origin);
 
     cairo_move_to(cr, creal(screen_origin), 0);
-    cairo_line_to(cr, creal(screen_origin), state->window->size);
+    cairo_line_to(cr, creal(screen_origin), state->window->height);
     cairo_move_to(cr, 0, cimag(screen_origin));
-    cairo_line_to(cr, state->window->size, cimag(screen_origin));
+    cairo_line_to(cr, state->window->width, cimag(screen_origin));
 
     cairo_stroke(cr);
 
@@ -27,7 +55,7 @@ void draw_axes(cairo_t* cr, State* state) {
 
     cairo_move_to(cr, creal(screen_origin) + 10, cimag(screen_origin) + 20);
     cairo_show_text(cr, "0");
-    cairo_move_to(cr, state->window->size - 30, cimag(screen_origin) + 20);
+    cairo_move_to(cr, state->window->width - 30, cimag(screen_origin) + 20);
     cairo_show_text(cr, "Re");
     cairo_move_to(cr, creal(screen_origin) + 10, 20);
     cairo_show_text(cr, "Im");
@@ -51,6 +79,11 @@ void draw_axes_ticks(cairo_t* cr, State* state) {
     double top_start = cimag(top_left_complex) -
                        fmod(cimag(top_left_complex), state->tick_step);
 
+    // Deep zooms have ticks closer than doubles resolve.
+    if (left_start + state->tick_step == left_start ||
+        top_start - state->tick_step == top_start)
+        return;
+
     for (double i = left_start; i < left_start + state->complex_width;
          i += state->tick_step) {
         if (i == 0.0) {
@@ -63,7 +96,9 @@ void draw_axes_ticks(cairo_t* cr, State* state) {
         cairo_line_to(cr, creal(tick_screen), cimag(tick_screen) + 5);
     }
 
-    for (double i = top_start; i > top_start - state->complex_width;
+    double complex_height =
+        state->complex_width * state->window->height / state->window->width;
+    for (double i = top_start; i > top_start - complex_height;
          i -= state->tick_step) {
         if (i == 0.0) {
             continue;
@@ -130,7 +165,8 @@ void draw_labels(cairo_t* cr, State* state) {
 
         cairo_move_to(cr, 10, 40);
         cairo_show_text(cr, "roots =");
-        for (int i = 0; i < state->fractals_config.newton.num_roots; i++) {
+        unsigned int num_roots = state->fractals_config.newton.num_roots;
+        for (unsigned int i = 0; i < num_roots && i < MAX_ROOT_LABELS; i++) {
             Pixel pixel = pixel_new_from_complex_plane_coordinates(
                 state, state->fractals_config.newton.roots[i]);
             char label[128];
@@ -138,6 +174,12 @@ void draw_labels(cairo_t* cr, State* state) {
             cairo_move_to(cr, 68, 40 + 20 * i);
             cairo_show_text(cr, label);
         }
+        if (num_roots > MAX_ROOT_LABELS) {
+            char label[32];
+            sprintf(label, "... %u roots", num_roots);
+            cairo_move_to(cr, 68, 40 + 20 * MAX_ROOT_LABELS);
+            cairo_show_text(cr, label);
+        }
 
     } else {
         if (state->fractal_type == FRACTAL_JULIA) {
@@ -168,11 +210,11 @@ void draw_labels(cairo_t* cr, State* state) {
         cairo_show_text(cr, max_iter_label);
     }
 
-    cairo_move_to(cr, 10, state->window->size - 16);
+    cairo_move_to(cr, 10, state->window->height - 16.0);
     cairo_show_text(cr, "graduation = ");
     char tick_step_label[16];
     sprintf(tick_step_label, "%g", state->tick_step);
-    cairo_move_to(cr, 112, state->window->size - 16);
+    cairo_move_to(cr, 112, state->window->height - 16.0);
     cairo_show_text(cr, tick_step_label);
 }
 
@@ -180,17 +222,18 @@ void draw_scale(cairo_t* cr, State* state) {
     set_overlay_colors(cr, state);
     cairo_set_line_width(cr, 2);
 
-    cairo_move_to(cr, state->window->size - 150, state->window->size - 10);
-    cairo_line_to(cr, state->window->size - 10, state->window->size - 10);
-    cairo_move_to(cr, state->window->size - 150, state->window->size - 10);
-    cairo_line_to(cr, state->window->size - 150, state->window->size - 20);
-    cairo_move_to(cr, state->window->size - 10, state->window->size - 10);
-    cairo_line_to(cr, state->window->size - 10, state->window->size - 20);
+    double width = state->window->width;
+    double height = state->window->height;
+    cairo_move_to(cr, width - 150, height - 10);
+    cairo_line_to(cr, width - 10, height - 10);
+    cairo_move_to(cr, width - 150, height - 10);
+    cairo_line_to(cr, width - 150, height - 20);
+    cairo_move_to(cr, width - 10, height - 10);
+    cairo_line_to(cr, width - 10, height - 20);
     cairo_stroke(cr);
 
-    double complex_equivalent =
-        map(140, 0, state->window->size, 0, state->complex_width);
-    cairo_move_to(cr, state->window->size - 126, state->window->size - 20);
+    double complex_equivalent = map(140, 0, width, 0, state->complex_width);
+    cairo_move_to(cr, width - 126, height - 20);
 
     char scale[16];
     sprintf(scale, "%g", complex_equivalent);
@@ -201,18 +244,87 @@ void draw_cross(cairo_t* cr, State* state) {
     set_overlay_colors(cr, state);
     cairo_set_line_width(cr, 2);
     // draw a 10 px cross at the center of the window
-    cairo_move_to(
-        cr, state->window->size / 2.0 - 10, state->window->size / 2.0);
-    cairo_line_to(
-        cr, state->window->size / 2.0 + 10, state->window->size / 2.0);
-    cairo_move_to(
-        cr, state->window->size / 2.0, state->window->size / 2.0 - 10);
-    cairo_line_to(
-        cr, state->window->size / 2.0, state->window->size / 2.0 + 10);
+    double center_x = state->window->width / 2.0;
+    double center_y = state->window->height / 2.0;
+    cairo_move_to(cr, center_x - 10, center_y);
+    cairo_line_to(cr, center_x + 10, center_y);
+    cairo_move_to(cr, center_x, center_y - 10);
+    cairo_line_to(cr, center_x, center_y + 10);
 
     cairo_stroke(cr);
 }
 
+static OverlayKey overlay_key(State* state) {
+    OverlayKey key;
+    memset(&key, 0, sizeof(key));
+
+    key.fractal_type = state->fractal_type;
+    key.width = state->window->width;
+    key.height = state->window->height;
+    key.scale = state->window->scale;
+    key.center = pixel_get_complex_plane_coordinates(&state->screen_center);
+    key.complex_width = state->complex_width;
+    key.max_iter = state->max_iter;
+    key.julia_z0 =
+        pixel_get_complex_plane_coordinates(&state->fractals_config.julia.z0);
+    key.newton_iterations = state->fractals_config.newton.iterations;
+    key.newton_num_roots = state->fractals_config.newton.num_roots;
+    memcpy(key.color, state->overlays_color, sizeof(key.color));
+
+    return key;
+}
+
+OverlayLayer* overlay_layer_new(void) {
+    return calloc(1, sizeof(OverlayLayer));
+}
+
+void overlay_layer_paint(OverlayLayer* layer, cairo_t* cr, State* state) {
+    OverlayKey key = overlay_key(state);
+    size_t roots_size = key.newton_num_roots * sizeof(double complex);
+
+    if (!layer->drawn || memcmp(&layer->key, &key, sizeof(key)) != 0 ||
+        memcmp(layer->newton_roots,
+               state->fractals_config.newton.roots,
+               roots_size) != 0) {
+        // Drawn at the resolution of the monitor, in logical pixels.
+        if (layer->surface == NULL || layer->key.width != key.width ||
+            layer->key.height != key.height || layer->key.scale != key.scale) {
+            if (layer->surface != NULL)
+                cairo_surface_destroy(layer->surface);
+            layer->surface =
+                cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                           key.width * key.scale,
+                                           key.height * key.scale);
+            cairo_surface_set_device_scale(
+                layer->surface, key.scale, key.scale);
+        }
+
+        cairo_t* layer_cr = cairo_create(layer->surface);
+        cairo_set_operator(layer_cr, CAIRO_OPERATOR_CLEAR);
+        cairo_paint(layer_cr);
+        cairo_set_operator(layer_cr, CAIRO_OPERATOR_OVER);
+        draw_overlays(layer_cr, state);
+        cairo_destroy(layer_cr);
+
+        layer->key = key;
+        layer->newton_roots = realloc(layer->newton_roots, roots_size);
+        memcpy(layer->newton_roots,
+               state->fractals_config.newton.roots,
+               roots_size);
+        layer->drawn = true;
+    }
+
+    cairo_set_source_surface(cr, layer->surface, 0, 0);
+    cairo_paint(cr);
+}
+
+void overlay_layer_free(OverlayLayer* layer) {
+    if (layer->surface != NULL)
+        cairo_surface_destroy(layer->surface);
+    free(layer->newton_roots);
+    free(layer);
+}
+
 void draw_overlays(cairo_t* cr, State* state) {
     draw_axes(cr, state);
     draw_labels(cr, state);
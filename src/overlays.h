@@ -16,3 +16,12 @@ void draw_scale(cairo_t* cr, State* state);
 void draw_cross(cairo_t* cr, State* state);
 
 void draw_overlays(cairo_t* cr, State* state);
+
+OverlayLayer* overlay_layer_new(void);
+
+// Paints the overlays of `state` over `cr`. They are drawn once into a
+// surface of their own, and drawn again only once something they show
+// changes, so that frames and toggles only cost a composite.
+void overlay_layer_paint(OverlayLayer* layer, cairo_t* cr, State* state);
+
+void overlay_layer_free(OverlayLayer* layer);
@@ -0,0 +1,93 @@
+#include "palette.h"
+#include <stdint.h>
+#include <string.h>
+#include <threads.h>
+
+#define MAX_STOPS 8
+
+typedef struct {
+    float position;
+    uint8_t rgb[3];
+} Stop;
+
+typedef struct {
+    const char* name;
+    unsigned int num_stops;
+    Stop stops[MAX_STOPS];
+} Gradient;
+
+// Stops are in increasing position from 0, and the gradient wraps from the
+// last one back to the first at position 1.
+static const Gradient gradients[PALETTE_NUM_TYPES] = {
+    [PALETTE_CLASSIC] = {"classic",
+                         5,
+                         {{0, {0, 7, 100}},
+                          {0.16, {32, 107, 203}},
+                          {0.42, {237, 255, 255}},
+                          {0.6425, {255, 170, 0}},
+                          {0.8575, {0, 2, 0}}}},
+    [PALETTE_FIRE] = {"fire",
+                      4,
+                      {{0, {0, 0, 0}},
+                       {0.3, {200, 20, 0}},
+                       {0.6, {255, 200, 0}},
+                       {0.8, {255, 255, 220}}}},
+    [PALETTE_OCEAN] = {"ocean",
+                       4,
+                       {{0, {0, 10, 30}},
+                        {0.35, {0, 90, 140}},
+                        {0.65, {80, 220, 200}},
+                        {0.85, {240, 255, 250}}}},
+    [PALETTE_GREY] = {"grey",
+                      2,
+                      {{0, {0, 0, 0}}, {0.5, {255, 255, 255}}}},
+};
+
+static uint32_t luts[PALETTE_NUM_TYPES][PALETTE_SIZE];
+static once_flag luts_once = ONCE_FLAG_INIT;
+
+static void build_lut(const Gradient* gradient, uint32_t* lut) {
+    unsigned int stop = 0;
+    for (unsigned int i = 0; i < PALETTE_SIZE; i++) {
+        float position = (float)i / PALETTE_SIZE;
+        while (stop + 1 < gradient->num_stops &&
+               gradient->stops[stop + 1].position <= position) {
+            stop++;
+        }
+
+        const Stop* from = &gradient->stops[stop];
+        const Stop* to = &gradient->stops[(stop + 1) % gradient->num_stops];
+        float end = stop + 1 < gradient->num_stops ? to->position : 1;
+        float t = (position - from->position) / (end - from->position);
+
+        lut[i] = 0xff000000;
+        for (unsigned int channel = 0; channel < 3; channel++) {
+            uint8_t value = from->rgb[channel] +
+                            t * (to->rgb[channel] - from->rgb[channel]) + 0.5f;
+            lut[i] |= (uint32_t)value << (16 - 8 * channel);
+        }
+    }
+}
+
+static void build_luts(void) {
+    for (unsigned int type = 0; type < PALETTE_NUM_TYPES; type++) {
+        build_lut(&gradients[type], luts[type]);
+    }
+}
+
+const char* palette_name(PALETTE_TYPE type) {
+    return gradients[type].name;
+}
+
+int palette_from_name(const char* name) {
+    for (int type = 0; type < PALETTE_NUM_TYPES; type++) {
+        if (strcmp(gradients[type].name, name) == 0)
+            return type;
+    }
+    return -1;
+}
+
+const uint32_t* palette_lut(PALETTE_TYPE type) {
+    call_once(&luts_once, build_luts);
+    return luts[type];
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+    PALETTE_CLASSIC,
+    PALETTE_FIRE,
+    PALETTE_OCEAN,
+    PALETTE_GREY,
+} PALETTE_TYPE;
+
+#define PALETTE_NUM_TYPES (PALETTE_GREY + 1)
+
+// Entries of a palette lookup table. A power of two, so that positions wrap
+// around with a mask.
+#define PALETTE_SIZE 1024
+
+const char* palette_name(PALETTE_TYPE type);
+
+// PALETTE_TYPE named `name`, or -1 if there is none.
+int palette_from_name(const char* name);
+
+// The gradient of `type` sampled at PALETTE_SIZE evenly spaced positions,
+// as opaque 0xAARRGGBB words. Gradients are cyclic: the last entry blends
+// back into the first. Tables are computed once, on first use from any
+// thread.
+const uint32_t* palette_lut(PALETTE_TYPE type);
@@ -0,0 +1,676 @@
+#include "perturbation.h"
+#include <complex.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include "bignum.h"
+#include "engine.h"
+
+// Bilinear approximation of `length` perturbation steps from some d_m:
+// d_{m + length} = a * d_m + b * dc, which holds while |d_m| < `radius`.
+typedef struct {
+    double complex a;
+    double complex b;
+    double radius;
+    unsigned int length;
+} Approximation;
+
+typedef struct {
+    unsigned int cell;
+    int64_t cell_x;
+    int64_t cell_y;
+    ReferenceOrbit* orbit;
+
+    // Batches iterating around it, which keep it from being evicted, and
+    // when it was last taken.
+    unsigned int users;
+    uint64_t last_used;
+} GlitchReference;
+
+struct ReferenceOrbit {
+    bool valid;
+    PRECISION_TYPE precision;
+    FRACTAL_TYPE fractal_type;
+    double complex julia_c;
+    int max_iter;
+
+    // Full precision position of the reference. Its orbit Z_0, Z_1, ... is
+    // kept in double precision, up to the iteration it escapes at.
+    BigComplex point;
+    double complex* orbit;
+    unsigned int length;
+
+    // Level k holds the approximations of 2^k steps from every multiple of
+    // 2^k, valid for every |dc| up to `max_dc`.
+    Approximation* approximations;
+    Approximation* levels[PERTURBATION_MAX_LEVELS];
+    unsigned int level_lengths[PERTURBATION_MAX_LEVELS];
+    unsigned int num_levels;
+    double max_dc;
+
+    // References of the glitched pixels of the grid of `glitch_center` and
+    // `glitch_step`, see PERTURBATION_GLITCH_CELL, shared by the threads of
+    // a pass through `glitch_mutex`. Once `glitch_capacity` are kept, new
+    // ones take the place of the least recently used.
+    mtx_t glitch_mutex;
+    GlitchReference glitch_references[PERTURBATION_MAX_GLITCH_REFERENCES];
+    unsigned int num_glitch_references;
+    unsigned int glitch_capacity;
+    uint64_t glitch_clock;
+    BigComplex glitch_center;
+    double glitch_step;
+    int glitch_max_iter;
+    PRECISION_TYPE glitch_precision;
+};
+
+static double norm(double complex z) {
+    return creal(z) * creal(z) + cimag(z) * cimag(z);
+}
+
+// Unevaluated sum of two doubles, with about 106 bits of mantissa.
+typedef struct {
+    double hi;
+    double lo;
+} DoubleDouble;
+
+static DoubleDouble dd_normalize(double hi, double lo) {
+    double sum = hi + lo;
+    return (DoubleDouble){sum, lo - (sum - hi)};
+}
+
+static DoubleDouble dd_add(DoubleDouble a, DoubleDouble b) {
+    double sum = a.hi + b.hi;
+    double b_part = sum - a.hi;
+    double error = (a.hi - (sum - b_part)) + (b.hi - b_part);
+    return dd_normalize(sum, error + a.lo + b.lo);
+}
+
+static DoubleDouble dd_sub(DoubleDouble a, DoubleDouble b) {
+    return dd_add(a, (DoubleDouble){-b.hi, -b.lo});
+}
+
+static DoubleDouble dd_mul(DoubleDouble a, DoubleDouble b) {
+    double product = a.hi * b.hi;
+    double error = fma(a.hi, b.hi, -product);
+    return dd_normalize(product, error + a.hi * b.lo + a.lo * b.hi);
+}
+
+static DoubleDouble dd_from_bignum(const BigNum* value) {
+    double hi = bignum_to_double(value);
+    BigNum rounded = bignum_from_double(hi);
+    BigNum remainder = bignum_sub(value, &rounded);
+    return (DoubleDouble){hi, bignum_to_double(&remainder)};
+}
+
+// Same as compute_orbit() in double-double, for views shallow enough.
+static void compute_orbit_double_double(ReferenceOrbit* reference,
+                                        const EngineParams* params,
+                                        const BigComplex* point) {
+    bool mandelbrot = params->fractal_type == FRACTAL_MANDELBROT;
+    DoubleDouble point_re = dd_from_bignum(&point->re);
+    DoubleDouble point_im = dd_from_bignum(&point->im);
+
+    DoubleDouble zr = mandelbrot ? (DoubleDouble){0} : point_re;
+    DoubleDouble zi = mandelbrot ? (DoubleDouble){0} : point_im;
+    DoubleDouble cr = mandelbrot ? point_re
+                                 : (DoubleDouble){creal(params->julia_c)};
+    DoubleDouble ci = mandelbrot ? point_im
+                                 : (DoubleDouble){cimag(params->julia_c)};
+
+    reference->orbit[0] = zr.hi + zi.hi * I;
+    reference->length = 1;
+
+    for (int i = 0; i < params->max_iter; i++) {
+        DoubleDouble re_im = dd_mul(zr, zi);
+        zr = dd_add(dd_sub(dd_mul(zr, zr), dd_mul(zi, zi)), cr);
+        zi = dd_add(dd_add(re_im, re_im), ci);
+
+        double complex value = zr.hi + zi.hi * I;
+        reference->orbit[reference->length++] = value;
+        if (norm(value) > 4)
+            break;
+    }
+}
+
+// Iterates the orbit of `point` in the precision `params` needs.
+static void compute_orbit(ReferenceOrbit* reference,
+                          const EngineParams* params,
+                          const BigComplex* point) {
+    bool mandelbrot = params->fractal_type == FRACTAL_MANDELBROT;
+
+    reference->valid = true;
+    reference->precision = engine_precision(params);
+    reference->fractal_type = params->fractal_type;
+    reference->julia_c = params->julia_c;
+    reference->max_iter = params->max_iter;
+    reference->point = *point;
+    reference->orbit = realloc(reference->orbit,
+                               (params->max_iter + 1) * sizeof(double complex));
+
+    if (reference->precision == PRECISION_DOUBLE_DOUBLE) {
+        compute_orbit_double_double(reference, params, point);
+        return;
+    }
+
+    BigComplex z = mandelbrot ? bigcomplex_from_complex(0) : *point;
+    BigComplex c =
+        mandelbrot ? *point : bigcomplex_from_complex(params->julia_c);
+
+    reference->orbit[0] = bigcomplex_to_complex(&z);
+    reference->length = 1;
+
+    for (int i = 0; i < params->max_iter; i++) {
+        BigNum re2 = bignum_mul(&z.re, &z.re);
+        BigNum im2 = bignum_mul(&z.im, &z.im);
+        BigNum re_im = bignum_mul(&z.re, &z.im);
+        BigNum twice_re_im = bignum_add(&re_im, &re_im);
+
+        BigNum re = bignum_sub(&re2, &im2);
+        z.re = bignum_add(&re, &c.re);
+        z.im = bignum_add(&twice_re_im, &c.im);
+
+        double complex value = bigcomplex_to_complex(&z);
+        reference->orbit[reference->length++] = value;
+        if (norm(value) > 4)
+            break;
+    }
+}
+
+// Builds the approximation table of the orbit, from single steps, where
+// d^2 is negligible next to 2 Z d, merged pairwise into longer ones.
+static void build_approximations(ReferenceOrbit* reference,
+                                 bool mandelbrot,
+                                 double max_dc) {
+    unsigned int steps = reference->length - 1;
+    reference->approximations =
+        realloc(reference->approximations,
+                (2 * steps + 1) * sizeof(Approximation));
+    reference->max_dc = max_dc;
+
+    Approximation* level = reference->approximations;
+    for (unsigned int m = 0; m < steps; m++) {
+        level[m] = (Approximation){
+            .a = 2 * reference->orbit[m],
+            .b = mandelbrot ? 1 : 0,
+            .radius = PERTURBATION_APPROXIMATION_TOLERANCE *
+                      cabs(reference->orbit[m]),
+            .length = 1,
+        };
+    }
+
+    reference->num_levels = 0;
+    unsigned int count = steps;
+    while (count > 0 && reference->num_levels < PERTURBATION_MAX_LEVELS) {
+        reference->levels[reference->num_levels] = level;
+        reference->level_lengths[reference->num_levels] = count;
+        reference->num_levels++;
+
+        // Applying x then y: d -> y.a * (x.a * d + x.b * dc) + y.b * dc.
+        Approximation* next = level + count;
+        for (unsigned int j = 0; j < count / 2; j++) {
+            const Approximation* x = &level[2 * j];
+            const Approximation* y = &level[2 * j + 1];
+            double y_radius =
+                (y->radius - cabs(x->b) * max_dc) / cabs(x->a);
+
+            next[j] = (Approximation){
+                .a = y->a * x->a,
+                .b = y->a * x->b + y->b,
+                .radius = fmin(x->radius, fmax(0, y_radius)),
+                .length = 2 * x->length,
+            };
+        }
+
+        level = next;
+        count /= 2;
+    }
+}
+
+// The longest approximation from d_m, with |d_m|^2 = `d_norm`, that skips
+// at most `max_length` steps, or NULL if none holds.
+static const Approximation* find_approximation(const ReferenceOrbit* reference,
+                                               unsigned int m,
+                                               double d_norm,
+                                               int max_length) {
+    int level = reference->num_levels - 1;
+    if (m > 0 && __builtin_ctz(m) < level)
+        level = __builtin_ctz(m);
+
+    for (; level >= 0; level--) {
+        unsigned int j = m >> level;
+        if (j >= reference->level_lengths[level] || (1 << level) > max_length)
+            continue;
+
+        const Approximation* approximation = &reference->levels[level][j];
+        if (d_norm < approximation->radius * approximation->radius)
+            return approximation;
+    }
+
+    return NULL;
+}
+
+ReferenceOrbit* reference_orbit_new(void) {
+    ReferenceOrbit* reference = calloc(1, sizeof(ReferenceOrbit));
+    mtx_init(&reference->glitch_mutex, mtx_plain);
+    return reference;
+}
+
+static void clear_glitch_references(ReferenceOrbit* reference) {
+    for (unsigned int i = 0; i < reference->num_glitch_references; i++) {
+        reference_orbit_free(reference->glitch_references[i].orbit);
+    }
+    reference->num_glitch_references = 0;
+}
+
+// Drops the references of glitched pixels unless they lie on the grid of
+// `params`, and were iterated as it would.
+static void update_glitch_references(ReferenceOrbit* reference,
+                                     const EngineParams* params) {
+    if (bigcomplex_equal(&reference->glitch_center, &params->deep_center) &&
+        reference->glitch_step == engine_step(params) &&
+        reference->glitch_max_iter == params->max_iter &&
+        reference->glitch_precision == engine_precision(params))
+        return;
+
+    clear_glitch_references(reference);
+    size_t orbit_size = (params->max_iter + 1) * sizeof(double complex);
+    reference->glitch_capacity = PERTURBATION_GLITCH_MEMORY / orbit_size;
+    if (reference->glitch_capacity > PERTURBATION_MAX_GLITCH_REFERENCES)
+        reference->glitch_capacity = PERTURBATION_MAX_GLITCH_REFERENCES;
+    reference->glitch_center = params->deep_center;
+    reference->glitch_step = engine_step(params);
+    reference->glitch_max_iter = params->max_iter;
+    reference->glitch_precision = engine_precision(params);
+}
+
+// Rebuilds the approximations when the pixels of the view lie further from
+// the reference than they hold for, or much closer, as tighter bounds
+// allow longer skips.
+static void update_approximations(ReferenceOrbit* reference,
+                                  const EngineParams* params) {
+    BigComplex offset = bigcomplex_sub(&params->deep_center, &reference->point);
+    double complex distance = bigcomplex_to_complex(&offset);
+    double step = engine_step(params);
+    double max_dc =
+        cabs(distance) +
+        step * hypot(params->width, engine_full_height(params)) / 2;
+
+    if (max_dc <= reference->max_dc && 2 * max_dc > reference->max_dc)
+        return;
+
+    build_approximations(
+        reference, params->fractal_type == FRACTAL_MANDELBROT, max_dc);
+}
+
+void reference_orbit_update(ReferenceOrbit* reference,
+                            const EngineParams* params) {
+    if (reference->valid && reference->precision >= engine_precision(params) &&
+        reference->fractal_type == params->fractal_type &&
+        (params->fractal_type != FRACTAL_JULIA ||
+         reference->julia_c == params->julia_c) &&
+        reference->max_iter >= params->max_iter) {
+        BigComplex offset =
+            bigcomplex_sub(&params->deep_center, &reference->point);
+        double complex distance = bigcomplex_to_complex(&offset);
+        double half_width = params->complex_width / 2;
+        double half_height =
+            engine_step(params) * engine_full_height(params) / 2;
+
+        if (fabs(creal(distance)) <= half_width &&
+            fabs(cimag(distance)) <= half_height) {
+            update_approximations(reference, params);
+            update_glitch_references(reference, params);
+            return;
+        }
+    }
+
+    compute_orbit(reference, params, &params->deep_center);
+    reference->max_dc = 0;
+    update_approximations(reference, params);
+    clear_glitch_references(reference);
+    update_glitch_references(reference, params);
+}
+
+void reference_orbit_free(ReferenceOrbit* reference) {
+    clear_glitch_references(reference);
+    mtx_destroy(&reference->glitch_mutex);
+    free(reference->approximations);
+    free(reference->orbit);
+    free(reference);
+}
+
+// Iterates the pixel c = C + dc, where C is the reference, through the
+// difference d_n = z_n - Z_n, skipping steps through the approximations
+// while |d_n| stays small. Whenever |z_n| falls below |d_n|, or the orbit
+// of the reference runs out, d_n is rebased onto the start of the orbit,
+// Z_0 = 0, which keeps d_n small and avoids glitches altogether.
+static int32_t iterate_mandelbrot(const ReferenceOrbit* reference,
+                                  double complex dc,
+                                  int max_iter,
+                                  float* magnitude,
+                                  uint64_t* iterations) {
+    const double complex* orbit = reference->orbit;
+    double complex d = 0;
+    *magnitude = 0;
+    unsigned int m = 0;
+    int n = 0;
+
+    while (n < max_iter) {
+        const Approximation* approximation =
+            find_approximation(reference, m, norm(d), max_iter - n);
+        if (approximation != NULL) {
+            d = approximation->a * d + approximation->b * dc;
+            m += approximation->length;
+            n += approximation->length;
+        } else {
+            d = (2 * orbit[m] + d) * d + dc;
+            m++;
+            n++;
+        }
+
+        double complex z = orbit[m] + d;
+        double z_norm = norm(z);
+        if (z_norm > 4) {
+            *magnitude = z_norm;
+            *iterations += n;
+            return n - 1;
+        }
+
+        if (z_norm < norm(d) || m == reference->length - 1) {
+            d = z;
+            m = 0;
+        }
+    }
+
+    *iterations += max_iter;
+    return -1;
+}
+
+// Iterates the pixel z_0 = Z_0 + d0 of a Julia set. Julia orbits can't be
+// rebased onto Z_0, so pixels whose difference to the reference outgrows
+// the precision of z are reported as `glitched`, unless `approximate`, in
+// which case they finish in plain double precision.
+static int32_t iterate_julia(const ReferenceOrbit* reference,
+                             double complex d0,
+                             double complex c,
+                             int max_iter,
+                             bool approximate,
+                             bool* glitched,
+                             float* magnitude,
+                             uint64_t* iterations) {
+    const double complex* orbit = reference->orbit;
+    double complex d = d0;
+    *magnitude = 0;
+    unsigned int m = 0;
+    int n = 0;
+
+    while (n < max_iter) {
+        const Approximation* approximation =
+            find_approximation(reference, m, norm(d), max_iter - n);
+        if (approximation != NULL) {
+            d = approximation->a * d;
+            m += approximation->length;
+            n += approximation->length;
+        } else {
+            d = (2 * orbit[m] + d) * d;
+            m++;
+            n++;
+        }
+
+        double complex z = orbit[m] + d;
+        double z_norm = norm(z);
+        if (z_norm > 4) {
+            *magnitude = z_norm;
+            *iterations += n;
+            return n - 1;
+        }
+
+        bool lost = z_norm < PERTURBATION_GLITCH_TOLERANCE * norm(orbit[m]);
+        if (!approximate && (lost || m == reference->length - 1)) {
+            *glitched = true;
+            *iterations += n;
+            return -1;
+        }
+
+        if (m == reference->length - 1) {
+            for (; n < max_iter; n++) {
+                z = z * z + c;
+                if (norm(z) > 4) {
+                    *magnitude = norm(z);
+                    *iterations += n + 1;
+                    return n;
+                }
+            }
+            break;
+        }
+    }
+
+    *iterations += max_iter;
+    return -1;
+}
+
+static int64_t floor_div(int64_t value, int64_t divisor) {
+    int64_t quotient = value / divisor;
+    if (value % divisor != 0 && value < 0)
+        quotient--;
+    return quotient;
+}
+
+static GlitchReference* find_glitch_reference(ReferenceOrbit* reference,
+                                              unsigned int cell,
+                                              int64_t cell_x,
+                                              int64_t cell_y) {
+    for (unsigned int i = 0; i < reference->num_glitch_references; i++) {
+        GlitchReference* glitch_reference = &reference->glitch_references[i];
+        if (glitch_reference->cell == cell &&
+            glitch_reference->cell_x == cell_x &&
+            glitch_reference->cell_y == cell_y)
+            return glitch_reference;
+    }
+    return NULL;
+}
+
+// A slot for a new reference, evicting the least recently used one no batch
+// is using once all are taken, or NULL if there is none.
+static GlitchReference* glitch_slot(ReferenceOrbit* reference) {
+    unsigned int count = reference->num_glitch_references;
+    if (count < reference->glitch_capacity) {
+        reference->num_glitch_references++;
+        return &reference->glitch_references[count];
+    }
+
+    GlitchReference* oldest = NULL;
+    for (unsigned int i = 0; i < reference->num_glitch_references; i++) {
+        GlitchReference* glitch_reference = &reference->glitch_references[i];
+        if (glitch_reference->users == 0 &&
+            (oldest == NULL ||
+             glitch_reference->last_used < oldest->last_used))
+            oldest = glitch_reference;
+    }
+    if (oldest != NULL)
+        reference_orbit_free(oldest->orbit);
+    return oldest;
+}
+
+// Takes the reference at `center`, the center of cell (`cell_x`, `cell_y`)
+// of the grid, computing it unless it is kept already. References that
+// can't be kept are returned in `own`. Either way, they go back through
+// release_glitch_reference().
+static GlitchReference* take_glitch_reference(ReferenceOrbit* reference,
+                                              const EngineParams* params,
+                                              unsigned int cell,
+                                              int64_t cell_x,
+                                              int64_t cell_y,
+                                              double complex center,
+                                              GlitchReference* own) {
+    mtx_lock(&reference->glitch_mutex);
+    GlitchReference* taken =
+        find_glitch_reference(reference, cell, cell_x, cell_y);
+    if (taken != NULL) {
+        taken->users++;
+        taken->last_used = ++reference->glitch_clock;
+        mtx_unlock(&reference->glitch_mutex);
+        return taken;
+    }
+    mtx_unlock(&reference->glitch_mutex);
+
+    // Computed unlocked, as the other threads may need other cells. Two of
+    // them computing the same one get the same orbit.
+    ReferenceOrbit* orbit = reference_orbit_new();
+    BigComplex point = bigcomplex_add_complex(&params->deep_center, center);
+    compute_orbit(orbit, params, &point);
+
+    mtx_lock(&reference->glitch_mutex);
+    taken = find_glitch_reference(reference, cell, cell_x, cell_y);
+    if (taken != NULL) {
+        reference_orbit_free(orbit);
+    } else {
+        taken = glitch_slot(reference);
+        if (taken != NULL)
+            *taken = (GlitchReference){cell, cell_x, cell_y, orbit};
+    }
+    if (taken != NULL) {
+        taken->users++;
+        taken->last_used = ++reference->glitch_clock;
+    }
+    mtx_unlock(&reference->glitch_mutex);
+
+    if (taken == NULL) {
+        *own = (GlitchReference){cell, cell_x, cell_y, orbit};
+        taken = own;
+    }
+    return taken;
+}
+
+static void release_glitch_reference(ReferenceOrbit* reference,
+                                     GlitchReference* taken,
+                                     GlitchReference* own) {
+    if (taken == own) {
+        reference_orbit_free(own->orbit);
+        return;
+    }
+
+    mtx_lock(&reference->glitch_mutex);
+    taken->users--;
+    mtx_unlock(&reference->glitch_mutex);
+}
+
+// Iterates the glitched pixels of a batch again, around the centers of the
+// cells they lie in, see PERTURBATION_GLITCH_CELL. Each pixel gets the same
+// references whatever batch it comes in, and neighbouring batches, which
+// glitch in the same places, share them.
+static void fix_glitches(const EngineParams* params,
+                         ReferenceOrbit* reference,
+                         const double* re,
+                         const double* im,
+                         unsigned int* glitched,
+                         unsigned int num_glitched,
+                         int32_t* values,
+                         float* magnitudes,
+                         uint64_t* iterations) {
+    double step = engine_step(params);
+
+    for (unsigned int round = 0;
+         round < PERTURBATION_MAX_REFERENCES && num_glitched > 0;
+         round++) {
+        unsigned int cell = PERTURBATION_GLITCH_CELL >> (2 * round);
+        bool approximate = round == PERTURBATION_MAX_REFERENCES - 1;
+
+        // Glitched pixels come in rows, mostly from the same cell as the
+        // one before.
+        GlitchReference own;
+        GlitchReference* taken = NULL;
+        double complex center = 0;
+
+        unsigned int remaining = 0;
+        for (unsigned int g = 0; g < num_glitched; g++) {
+            unsigned int i = glitched[g];
+            int64_t cell_x = floor_div(llround(re[i] / step), cell);
+            int64_t cell_y = floor_div(llround(-im[i] / step), cell);
+            if (taken == NULL || cell_x != taken->cell_x ||
+                cell_y != taken->cell_y) {
+                if (taken != NULL)
+                    release_glitch_reference(reference, taken, &own);
+                center = ((double)(cell_x * cell + cell / 2) -
+                          (double)(cell_y * cell + cell / 2) * I) *
+                         step;
+                taken = take_glitch_reference(
+                    reference, params, cell, cell_x, cell_y, center, &own);
+            }
+
+            double complex d0 = (re[i] - creal(center)) +
+                                (im[i] - cimag(center)) * I;
+            bool glitch = false;
+            values[i] = iterate_julia(taken->orbit,
+                                      d0,
+                                      params->julia_c,
+                                      params->max_iter,
+                                      approximate,
+                                      &glitch,
+                                      &magnitudes[i],
+                                      iterations);
+            if (glitch)
+                glitched[remaining++] = i;
+        }
+        if (taken != NULL)
+            release_glitch_reference(reference, taken, &own);
+        num_glitched = remaining;
+    }
+}
+
+void perturbation_sample_points(const EngineParams* params,
+                                ReferenceOrbit* reference,
+                                const double* re,
+                                const double* im,
+                                unsigned int count,
+                                int32_t* values,
+                                float* magnitudes,
+                                uint64_t* iterations) {
+    // Points are given relative to the center of the view.
+    BigComplex distance =
+        bigcomplex_sub(&params->deep_center, &reference->point);
+    double complex center = bigcomplex_to_complex(&distance);
+
+    if (params->fractal_type == FRACTAL_MANDELBROT) {
+        for (unsigned int i = 0; i < count; i++) {
+            values[i] = iterate_mandelbrot(reference,
+                                           center + re[i] + im[i] * I,
+                                           params->max_iter,
+                                           &magnitudes[i],
+                                           iterations);
+        }
+        return;
+    }
+
+    unsigned int glitched[ENGINE_BATCH_SIZE];
+    unsigned int num_glitched = 0;
+
+    for (unsigned int i = 0; i < count; i++) {
+        bool glitch = false;
+        values[i] = iterate_julia(reference,
+                                  center + re[i] + im[i] * I,
+                                  params->julia_c,
+                                  params->max_iter,
+                                  false,
+                                  &glitch,
+                                  &magnitudes[i],
+                                  iterations);
+        if (glitch)
+            glitched[num_glitched++] = i;
+    }
+
+    if (num_glitched > 0) {
+        fix_glitches(params,
+                     reference,
+                     re,
+                     im,
+                     glitched,
+                     num_glitched,
+                     values,
+                     magnitudes,
+                     iterations);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "engine.h"
+
+// Glitch test of the Julia kernel: a pixel whose |z|^2 drops below this
+// fraction of the reference's has lost its precision.
+#define PERTURBATION_GLITCH_TOLERANCE 1e-6
+
+// Bilinear approximations skip steps while d^2 stays below this fraction of
+// 2 Z d, which keeps their error within the rounding noise of the steps.
+#define PERTURBATION_APPROXIMATION_TOLERANCE 0x1p-28
+
+// Approximations skip at most 2^(levels - 1) steps at once.
+#define PERTURBATION_MAX_LEVELS 24
+
+// Glitched pixels are iterated again around the center of the cell of the
+// grid they lie in, this many pixels on each side, then of cells a quarter
+// as wide, for up to PERTURBATION_MAX_REFERENCES rounds, the last of which
+// settles for an approximation.
+#define PERTURBATION_GLITCH_CELL 64
+#define PERTURBATION_MAX_REFERENCES 2
+
+// The references of those cells are kept for the next batches and passes,
+// up to this many bytes of orbits, and this many references.
+#define PERTURBATION_GLITCH_MEMORY (64 << 20)
+#define PERTURBATION_MAX_GLITCH_REFERENCES 256
+
+ReferenceOrbit* reference_orbit_new(void);
+
+// Keeps `reference` while it lies within the view and iterates the same
+// fractal as `params`, and computes a new one at the center of the view
+// otherwise. The references of glitched pixels carry over while the grid
+// stays the same.
+void reference_orbit_update(ReferenceOrbit* reference,
+                            const EngineParams* params);
+
+void reference_orbit_free(ReferenceOrbit* reference);
+
+// Same as engine_sample_points() for deep zooms, where each point is the
+// offset of a pixel from `params->deep_center`. Only the orbit of the
+// reference is iterated at full precision; pixels iterate in double
+// precision their difference to it. Safe to call from several threads at
+// once on the same `reference`.
+void perturbation_sample_points(const EngineParams* params,
+                                ReferenceOrbit* reference,
+                                const double* re,
+                                const double* im,
+                                unsigned int count,
+                                int32_t* values,
+                                float* magnitudes,
+                                uint64_t* iterations);
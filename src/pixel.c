@@ -15,17 +15,19 @@ double complex screen_to_complex_plane_coordinates(
     double complex coordinates,
     double complex screen_center_in_complex_plane,
     double complex width,
-    int size) {
+    int screen_width,
+    int screen_height) {
+    double complex height = width * screen_height / screen_width;
     double x = map(creal(coordinates),
                    0,
-                   size,
+                   screen_width,
                    creal(screen_center_in_complex_plane) - width / 2,
                    creal(screen_center_in_complex_plane) + width / 2);
     double y = map(cimag(coordinates),
                    0,
-                   size,
-                   cimag(screen_center_in_complex_plane) + width / 2,
-                   cimag(screen_center_in_complex_plane) - width / 2);
+                   screen_height,
+                   cimag(screen_center_in_complex_plane) + height / 2,
+                   cimag(screen_center_in_complex_plane) - height / 2);
 
     return x + y * I;
 }
@@ -33,16 +35,18 @@ double complex complex_plane_to_screen_coordinates(
     double complex coordinates,
     double complex screen_center_in_complex_plane,
     double complex width,
-    int size) {
+    int screen_width,
+    int screen_height) {
+    double complex height = width * screen_height / screen_width;
     double x = map(creal(coordinates),
                    creal(screen_center_in_complex_plane) - width / 2,
                    creal(screen_center_in_complex_plane) + width / 2,
                    0,
-                   size);
+                   screen_width);
     double y = map(cimag(coordinates),
-                   cimag(screen_center_in_complex_plane) - width / 2,
-                   cimag(screen_center_in_complex_plane) + width / 2,
-                   size,
+                   cimag(screen_center_in_complex_plane) - height / 2,
+                   cimag(screen_center_in_complex_plane) + height / 2,
+                   screen_height,
                    0);
 
     return x + y * I;
@@ -81,7 +85,8 @@ double complex pixel_get_complex_plane_coordinates(Pixel* pixel) {
         pixel->_screen_coordinates,
         pixel_get_complex_plane_coordinates(&pixel->_state->screen_center),
         pixel->_state->complex_width,
-        pixel->_state->window->size);
+        pixel->_state->window->width,
+        pixel->_state->window->height);
 
     pixel->_complex_plane_coordinates_cached = true;
 
@@ -97,7 +102,8 @@ double complex pixel_get_screen_coordinates(Pixel* pixel) {
         pixel->_complex_plane_coordinates,
         pixel_get_complex_plane_coordinates(&pixel->_state->screen_center),
         pixel->_state->complex_width,
-        pixel->_state->window->size);
+        pixel->_state->window->width,
+        pixel->_state->window->height);
 
     pixel->_screen_coordinates_cached = true;
 
@@ -32,13 +32,15 @@ double complex screen_to_complex_plane_coordinates(
     double complex coordinates,
     double complex screen_center_in_complex_plane,
     double complex width,
-    int size);
+    int screen_width,
+    int screen_height);
 
 double complex complex_plane_to_screen_coordinates(
     double complex coordinates,
     double complex screen_center_in_complex_plane,
     double complex width,
-    int size);
+    int screen_width,
+    int screen_height);
 
 Pixel pixel_new_from_complex_plane_coordinates(State* state,
                                                double complex coordinates);
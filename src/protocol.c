@@ -0,0 +1,447 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "protocol.h"
+#include <complex.h>
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "bignum.h"
+
+#define UNIX_PREFIX "unix:"
+
+static void set_timeout(int socket, int option) {
+    struct timeval timeout = {.tv_sec = PROTOCOL_TIMEOUT_SECONDS};
+    setsockopt(socket, SOL_SOCKET, option, &timeout, sizeof(timeout));
+}
+
+// Jobs and tiles go out as soon as they are written, rather than waiting
+// on the acknowledgement of the length sent in front of them.
+static void set_no_delay(int socket, int family) {
+    int one = 1;
+    if (family != AF_UNIX)
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static int open_address(int family,
+                        const struct sockaddr* address,
+                        socklen_t size,
+                        bool listening) {
+    int fd = socket(family, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    bool opened;
+    if (listening) {
+        int one = 1;
+        if (family != AF_UNIX)
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        opened = bind(fd, address, size) == 0 && listen(fd, SOMAXCONN) == 0;
+    } else {
+        opened = connect(fd, address, size) == 0;
+        set_no_delay(fd, family);
+        set_timeout(fd, SO_RCVTIMEO);
+        set_timeout(fd, SO_SNDTIMEO);
+    }
+
+    if (!opened) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+static int open_socket(const char* address, bool listening) {
+    if (strncmp(address, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0) {
+        const char* path = address + strlen(UNIX_PREFIX);
+        struct sockaddr_un local = {.sun_family = AF_UNIX};
+        if (strlen(path) >= sizeof(local.sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        strcpy(local.sun_path, path);
+
+        // A worker that stopped leaves its socket behind.
+        struct stat status;
+        if (listening && stat(path, &status) == 0 && S_ISSOCK(status.st_mode))
+            unlink(path);
+
+        return open_address(
+            AF_UNIX, (struct sockaddr*)&local, sizeof(local), listening);
+    }
+
+    const char* colon = strrchr(address, ':');
+    if (colon == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // IPv6 hosts come in brackets, as in "[::1]:7000".
+    char* host = strndup(address, colon - address);
+    char* name = host;
+    size_t length = strlen(host);
+    if (length >= 2 && host[0] == '[' && host[length - 1] == ']') {
+        host[length - 1] = '\0';
+        name++;
+    }
+
+    struct addrinfo hints = {
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = listening ? AI_PASSIVE : 0,
+    };
+    struct addrinfo* addresses;
+    int status = getaddrinfo(
+        name[0] != '\0' ? name : NULL, colon + 1, &hints, &addresses);
+    free(host);
+    if (status != 0) {
+        if (status != EAI_SYSTEM)
+            errno = EHOSTUNREACH;
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* candidate = addresses; candidate != NULL && fd < 0;
+         candidate = candidate->ai_next) {
+        fd = open_address(candidate->ai_family,
+                          candidate->ai_addr,
+                          candidate->ai_addrlen,
+                          listening);
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+int protocol_connect(const char* address) {
+    return open_socket(address, false);
+}
+
+int protocol_listen(const char* address) {
+    return open_socket(address, true);
+}
+
+int protocol_accept(int listener) {
+    struct sockaddr_storage address;
+    socklen_t size = sizeof(address);
+    int fd;
+    do {
+        fd = accept(listener, (struct sockaddr*)&address, &size);
+    } while (fd < 0 && errno == EINTR);
+
+    if (fd >= 0) {
+        set_no_delay(fd, address.ss_family);
+        set_timeout(fd, SO_SNDTIMEO);
+    }
+    return fd;
+}
+
+static void store_u32(unsigned char* bytes, uint32_t value) {
+    bytes[0] = value >> 24;
+    bytes[1] = value >> 16;
+    bytes[2] = value >> 8;
+    bytes[3] = value;
+}
+
+static uint32_t load_u32(const unsigned char* bytes) {
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+           (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+static bool send_all(int socket, const unsigned char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(socket, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static bool receive_all(int socket, unsigned char* data, size_t size) {
+    while (size > 0) {
+        ssize_t received = recv(socket, data, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+static void reserve(Message* message, size_t size) {
+    if (message->size + size <= message->capacity)
+        return;
+
+    message->capacity = 2 * message->capacity > message->size + size
+                            ? 2 * message->capacity
+                            : message->size + size;
+    message->data = realloc(message->data, message->capacity);
+}
+
+bool protocol_send(int socket, const Message* message) {
+    unsigned char length[4];
+    store_u32(length, message->size);
+    return send_all(socket, length, sizeof(length)) &&
+           send_all(socket, message->data, message->size);
+}
+
+bool protocol_receive(int socket, Message* message) {
+    unsigned char length[4];
+    if (!receive_all(socket, length, sizeof(length)))
+        return false;
+
+    size_t size = load_u32(length);
+    if (size > PROTOCOL_MAX_MESSAGE_SIZE)
+        return false;
+
+    message_clear(message);
+    reserve(message, size);
+    if (!receive_all(socket, message->data, size))
+        return false;
+    message->size = size;
+    return true;
+}
+
+void message_clear(Message* message) {
+    message->size = 0;
+    message->offset = 0;
+    message->overflow = false;
+}
+
+void message_free(Message* message) {
+    free(message->data);
+    *message = (Message){0};
+}
+
+static void put_u32(Message* message, uint32_t value) {
+    reserve(message, 4);
+    store_u32(&message->data[message->size], value);
+    message->size += 4;
+}
+
+static void put_u64(Message* message, uint64_t value) {
+    put_u32(message, value >> 32);
+    put_u32(message, value);
+}
+
+static void put_f64(Message* message, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u64(message, bits);
+}
+
+static void put_bignum(Message* message, const BigNum* value) {
+    put_u32(message, value->negative);
+    for (int i = 0; i < BIGNUM_LIMBS; i++) {
+        put_u32(message, value->limbs[i]);
+    }
+}
+
+static uint32_t get_u32(Message* message) {
+    if (message->overflow || message->size - message->offset < 4) {
+        message->overflow = true;
+        return 0;
+    }
+    uint32_t value = load_u32(&message->data[message->offset]);
+    message->offset += 4;
+    return value;
+}
+
+static uint64_t get_u64(Message* message) {
+    uint64_t high = get_u32(message);
+    return high << 32 | get_u32(message);
+}
+
+static double get_f64(Message* message) {
+    uint64_t bits = get_u64(message);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static BigNum get_bignum(Message* message) {
+    BigNum value = {.negative = get_u32(message) != 0};
+    for (int i = 0; i < BIGNUM_LIMBS; i++) {
+        value.limbs[i] = get_u32(message);
+    }
+    return value;
+}
+
+void protocol_put_job(Message* message, const ProtocolJob* job) {
+    const EngineParams* params = &job->params;
+    message_clear(message);
+    put_u32(message, PROTOCOL_VERSION);
+    put_u32(message, job->id);
+    put_u32(message, job->top);
+    put_u32(message, job->rows);
+
+    put_u32(message, params->fractal_type);
+    put_u32(message, params->width);
+    put_u32(message, params->height);
+    put_u32(message, params->band_top);
+    put_u32(message, params->full_height);
+    put_f64(message, creal(params->center));
+    put_f64(message, cimag(params->center));
+    put_f64(message, params->complex_width);
+    put_bignum(message, &params->deep_center.re);
+    put_bignum(message, &params->deep_center.im);
+    put_u32(message, params->max_iter);
+    put_f64(message, creal(params->julia_c));
+    put_f64(message, cimag(params->julia_c));
+    put_u32(message, params->newton_num_roots);
+    for (unsigned int i = 0; i < params->newton_num_roots; i++) {
+        put_f64(message, creal(params->newton_roots[i]));
+        put_f64(message, cimag(params->newton_roots[i]));
+    }
+    put_u32(message, params->newton_iterations);
+    put_u32(message, params->precision);
+    put_u32(message, params->subdivide);
+}
+
+bool protocol_get_job(Message* message, ProtocolJob* job) {
+    message->offset = 0;
+    message->overflow = false;
+    *job = (ProtocolJob){0};
+    if (get_u32(message) != PROTOCOL_VERSION)
+        return false;
+
+    EngineParams* params = &job->params;
+    job->id = get_u32(message);
+    job->top = get_u32(message);
+    job->rows = get_u32(message);
+
+    params->fractal_type = get_u32(message);
+    params->width = get_u32(message);
+    params->height = get_u32(message);
+    params->band_top = get_u32(message);
+    params->full_height = get_u32(message);
+    params->center = get_f64(message);
+    params->center += get_f64(message) * I;
+    params->complex_width = get_f64(message);
+    params->deep_center.re = get_bignum(message);
+    params->deep_center.im = get_bignum(message);
+    params->max_iter = (int32_t)get_u32(message);
+    params->julia_c = get_f64(message);
+    params->julia_c += get_f64(message) * I;
+
+    // Checked against what the message holds before allocating anything.
+    params->newton_num_roots = get_u32(message);
+    if (params->newton_num_roots > (message->size - message->offset) / 16)
+        return false;
+    double complex* roots =
+        malloc((params->newton_num_roots + 1) * sizeof(double complex));
+    for (unsigned int i = 0; i < params->newton_num_roots; i++) {
+        roots[i] = get_f64(message);
+        roots[i] += get_f64(message) * I;
+    }
+    params->newton_roots = roots;
+
+    params->newton_iterations = get_u32(message);
+    params->precision = get_u32(message);
+    params->subdivide = get_u32(message) != 0;
+
+    bool valid =
+        !message->overflow && message->offset == message->size &&
+        params->fractal_type <= FRACTAL_NEWTON && params->width > 0 &&
+        params->height > 0 &&
+        job->rows > 0 && job->top < params->height &&
+        job->rows <= params->height - job->top &&
+        (uint64_t)params->width * job->rows <= PROTOCOL_MAX_MESSAGE_SIZE / 8 &&
+        (params->full_height == 0 ||
+         (params->band_top < params->full_height &&
+          params->height <= params->full_height - params->band_top)) &&
+        isfinite(params->complex_width) && params->complex_width > 0 &&
+        params->max_iter > 0 && params->precision < PRECISION_NUM_TYPES &&
+        (params->fractal_type != FRACTAL_NEWTON ||
+         params->newton_num_roots > 0);
+    if (!valid)
+        protocol_job_free(job);
+    return valid;
+}
+
+void protocol_job_free(ProtocolJob* job) {
+    free((double complex*)job->params.newton_roots);
+    job->params.newton_roots = NULL;
+}
+
+// Tiles hold the values of their pixels, then the bits of their
+// magnitudes, compressed together.
+void protocol_put_tile(Message* message,
+                       uint32_t id,
+                       uint64_t iterations,
+                       const EngineFrame* frame,
+                       unsigned int top,
+                       unsigned int rows) {
+    message_clear(message);
+    put_u32(message, PROTOCOL_VERSION);
+    put_u32(message, id);
+    put_u64(message, iterations);
+
+    size_t count = (size_t)rows * frame->width;
+    size_t first = (size_t)top * frame->width;
+    size_t raw_size = 8 * count;
+    unsigned char* raw = malloc(raw_size);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t magnitude;
+        memcpy(&magnitude, &frame->magnitudes[first + i], sizeof(magnitude));
+        store_u32(&raw[4 * i], frame->values[first + i]);
+        store_u32(&raw[4 * (count + i)], magnitude);
+    }
+
+    uLongf size = compressBound(raw_size);
+    reserve(message, size);
+    compress2(&message->data[message->size], &size, raw, raw_size, 1);
+    message->size += size;
+    free(raw);
+}
+
+bool protocol_get_tile(Message* message,
+                       uint32_t id,
+                       EngineFrame* frame,
+                       unsigned int top,
+                       unsigned int rows,
+                       uint64_t* iterations) {
+    message->offset = 0;
+    message->overflow = false;
+    if (get_u32(message) != PROTOCOL_VERSION || get_u32(message) != id)
+        return false;
+    *iterations = get_u64(message);
+    if (message->overflow)
+        return false;
+
+    size_t count = (size_t)rows * frame->width;
+    size_t first = (size_t)top * frame->width;
+    size_t raw_size = 8 * count;
+    unsigned char* raw = malloc(raw_size);
+    uLongf size = raw_size;
+    bool valid = uncompress(raw,
+                            &size,
+                            &message->data[message->offset],
+                            message->size - message->offset) == Z_OK &&
+                 size == raw_size;
+
+    for (size_t i = 0; valid && i < count; i++) {
+        uint32_t magnitude = load_u32(&raw[4 * (count + i)]);
+        frame->values[first + i] = (int32_t)load_u32(&raw[4 * i]);
+        memcpy(&frame->magnitudes[first + i], &magnitude, sizeof(magnitude));
+    }
+    free(raw);
+    return valid;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine.h"
+
+// Bumped whenever the messages change, so that mismatched builds refuse
+// each other's work instead of misreading it.
+#define PROTOCOL_VERSION 2
+
+// Messages larger than this are treated as a broken connection.
+#define PROTOCOL_MAX_MESSAGE_SIZE (1u << 30)
+
+// Sockets give up on a peer that neither sends nor takes anything for this
+// long.
+#define PROTOCOL_TIMEOUT_SECONDS 600
+
+// Growable buffer holding one message, written and read in network byte
+// order. Reads past the end set `overflow` and return zeros.
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    size_t offset;
+    bool overflow;
+} Message;
+
+// Rows `top` to `top + rows` of the frame of `params`, rendered at full
+// resolution by a worker for the coordinator. `params` owns its Newton
+// roots once read by protocol_get_job(), and needs protocol_job_free().
+typedef struct {
+    uint32_t id;
+    unsigned int top;
+    unsigned int rows;
+    EngineParams params;
+} ProtocolJob;
+
+// Connects to, or listens on, `address`: "unix:PATH" for a Unix socket, and
+// "HOST:PORT" for TCP otherwise. Return the socket, or -1 with errno set.
+// Connections time out after PROTOCOL_TIMEOUT_SECONDS without progress.
+int protocol_connect(const char* address);
+int protocol_listen(const char* address);
+
+// Waits for the next connection to `listener`. Accepted connections wait
+// for messages as long as it takes, and only time out sending.
+int protocol_accept(int listener);
+
+// Sends or receives a whole message, with its length in front. Return false
+// once the connection broke or timed out.
+bool protocol_send(int socket, const Message* message);
+bool protocol_receive(int socket, Message* message);
+
+void message_clear(Message* message);
+void message_free(Message* message);
+
+void protocol_put_job(Message* message, const ProtocolJob* job);
+bool protocol_get_job(Message* message, ProtocolJob* job);
+void protocol_job_free(ProtocolJob* job);
+
+// Compressed samples of rows `top` to `top + rows` of `frame`, in answer to
+// job `id`.
+void protocol_put_tile(Message* message,
+                       uint32_t id,
+                       uint64_t iterations,
+                       const EngineFrame* frame,
+                       unsigned int top,
+                       unsigned int rows);
+
+// Reads the samples of a tile into the same rows of `frame`. Returns false,
+// leaving them partly written, when the message isn't the answer to job
+// `id` covering them.
+bool protocol_get_tile(Message* message,
+                       uint32_t id,
+                       EngineFrame* frame,
+                       unsigned int top,
+                       unsigned int rows,
+                       uint64_t* iterations);
@@ -0,0 +1,453 @@
+#include "renderer.h"
+#include <gtk/gtk.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "antialias.h"
+#include "engine.h"
+#include "newton.h"
+#include "perturbation.h"
+#include "tile_cache.h"
+
+struct Renderer {
+    // Size of the frames, which follows the params submitted.
+    unsigned int width;
+    unsigned int height;
+
+    // Passes get colored into `next`, which then takes the place of
+    // `front`, the surface on display. Only the swap needs the mutex, so
+    // the display never waits on the coloring, nor the other way around.
+    cairo_surface_t* front;
+    cairo_surface_t* next;
+
+    // Raw samples of the frame being rendered, colored as passes complete.
+    EngineFrame* back;
+    unsigned char* quality;
+    TileCache* cache;
+
+    // Kept across frames, so that deep zooms only compute a new reference
+    // once the view leaves the current one, and Newton fractals only index
+    // their roots again once they move.
+    ReferenceOrbit* reference;
+    NewtonIndex* newton_index;
+
+    // Spare buffers the back buffer gets reprojected into.
+    EngineFrame* scratch;
+    unsigned char* scratch_quality;
+
+    // The params of the frame held by `back`, and whether all its pixels
+    // are exact, in which case frames that only color it differently need
+    // no rendering at all.
+    EngineParams shown;
+    double complex* shown_roots;
+    bool has_shown;
+    bool shown_complete;
+
+    void (*on_frame)(gpointer data);
+    gpointer data;
+
+    GThread* thread;
+    GMutex mutex;
+    GCond cond;
+
+    // The latest submission, kept once rendering so that submitting the same
+    // params again, as any handler that didn't end up changing anything
+    // does, leaves the frame on display and the render in progress alone.
+    EngineParams pending;
+    double complex* pending_roots;
+    bool has_submitted;
+    bool has_pending;
+    bool pending_interactive;
+    bool quit;
+
+    // Fraction of the iterations interactive frames run, tuned by the time
+    // they take.
+    double iteration_scale;
+
+    atomic_bool cancel;
+    atomic_bool frame_queued;
+
+    // Idle source calling `on_frame` once a frame is published, 0 when none
+    // is pending. Guarded by `mutex`, and removed by renderer_free() so that
+    // it never runs on a freed renderer.
+    guint frame_source;
+};
+
+static gboolean frame_ready(gpointer data) {
+    Renderer* renderer = data;
+    g_mutex_lock(&renderer->mutex);
+    renderer->frame_source = 0;
+    atomic_store(&renderer->frame_queued, false);
+    g_mutex_unlock(&renderer->mutex);
+    renderer->on_frame(renderer->data);
+    return G_SOURCE_REMOVE;
+}
+
+static void copy_roots(double complex** destination,
+                       const double complex* roots,
+                       unsigned int num_roots) {
+    *destination = realloc(*destination, num_roots * sizeof(double complex));
+    memcpy(*destination, roots, num_roots * sizeof(double complex));
+}
+
+static void publish(Renderer* renderer, const EngineParams* params) {
+    // Surfaces catch up with the size of the frames as they come back from
+    // display.
+    if (cairo_image_surface_get_width(renderer->next) != renderer->width ||
+        cairo_image_surface_get_height(renderer->next) != renderer->height) {
+        cairo_surface_destroy(renderer->next);
+        renderer->next = cairo_image_surface_create(
+            CAIRO_FORMAT_ARGB32, renderer->width, renderer->height);
+    }
+
+    cairo_surface_flush(renderer->next);
+    engine_colorize(
+        params,
+        renderer->back,
+        (uint32_t*)cairo_image_surface_get_data(renderer->next),
+        cairo_image_surface_get_stride(renderer->next) / sizeof(uint32_t));
+    cairo_surface_mark_dirty(renderer->next);
+
+    g_mutex_lock(&renderer->mutex);
+    cairo_surface_t* front = renderer->front;
+    renderer->front = renderer->next;
+    renderer->next = front;
+    g_mutex_unlock(&renderer->mutex);
+
+    g_mutex_lock(&renderer->mutex);
+    if (!atomic_exchange(&renderer->frame_queued, true))
+        renderer->frame_source = g_idle_add(frame_ready, renderer);
+    g_mutex_unlock(&renderer->mutex);
+}
+
+// Both return whether the frame got completed.
+static bool render_cached(Renderer* renderer, const EngineParams* params) {
+    for (unsigned int block = RENDERER_FIRST_BLOCK; block >= 1; block /= 2) {
+        bool complete = tile_cache_render(
+            renderer->cache, params, renderer->back, block, NULL);
+        if (atomic_load(&renderer->cancel))
+            return false;
+
+        publish(renderer, params);
+
+        if (complete)
+            break;
+    }
+    return true;
+}
+
+static bool render_progressive(Renderer* renderer, const EngineParams* params) {
+    for (unsigned int block = RENDERER_FIRST_BLOCK; block >= 1; block /= 2) {
+        engine_render_pass(params, renderer->back, block, false, NULL);
+        if (atomic_load(&renderer->cancel))
+            return false;
+
+        publish(renderer, params);
+    }
+    return true;
+}
+
+// Renders passes while the next one, with about four times the samples of
+// the last, still fits the frame budget. The iterations are halved for the
+// next frames when even the first pass overruns, cancelled or not, and
+// doubled back when the whole frame fits with room to spare.
+static void render_interactive(Renderer* renderer, const EngineParams* params) {
+    gint64 start = g_get_monotonic_time();
+    gint64 pass_start = start;
+    gint64 now = start;
+    unsigned int block = RENDERER_FIRST_BLOCK;
+    bool cancelled = false;
+    while (true) {
+        engine_render_pass(params, renderer->back, block, false, NULL);
+        now = g_get_monotonic_time();
+        cancelled = atomic_load(&renderer->cancel);
+        if (cancelled)
+            break;
+
+        publish(renderer, params);
+
+        if (block == 1 ||
+            now - start + 4 * (now - pass_start) > RENDERER_FRAME_BUDGET)
+            break;
+        pass_start = now;
+        block /= 2;
+    }
+
+    if (block == RENDERER_FIRST_BLOCK && now - start > RENDERER_FRAME_BUDGET) {
+        renderer->iteration_scale = fmax(renderer->iteration_scale / 2,
+                                         RENDERER_MIN_ITERATION_SCALE);
+    } else if (!cancelled && block == 1 &&
+               now - start < RENDERER_FRAME_BUDGET / 2) {
+        renderer->iteration_scale = fmin(renderer->iteration_scale * 2, 1);
+    }
+}
+
+static void resize_frame(EngineFrame** frame,
+                         unsigned char** quality,
+                         unsigned int width,
+                         unsigned int height) {
+    engine_frame_free(*frame);
+    free(*quality);
+    *frame = engine_frame_new(width, height);
+    *quality = malloc(width * height);
+}
+
+// Starts the frame from the previous one, resampled to the new view, so that
+// pans, zooms and resizes show something right away and only compute what
+// the previous frame can't provide.
+static void reproject(Renderer* renderer, const EngineParams* params) {
+    // The back buffer keeps its size until reprojected from.
+    bool resized =
+        params->width != renderer->width || params->height != renderer->height;
+    if (resized) {
+        renderer->width = params->width;
+        renderer->height = params->height;
+        resize_frame(&renderer->scratch,
+                     &renderer->scratch_quality,
+                     params->width,
+                     params->height);
+    }
+
+    if (!renderer->has_shown || !engine_reproject(&renderer->shown,
+                                                  renderer->back,
+                                                  renderer->quality,
+                                                  params,
+                                                  renderer->scratch,
+                                                  renderer->scratch_quality)) {
+        if (resized) {
+            resize_frame(&renderer->back,
+                         &renderer->quality,
+                         params->width,
+                         params->height);
+        }
+        memset(renderer->quality,
+               ENGINE_QUALITY_MISSING,
+               renderer->width * renderer->height);
+        renderer->back->num_edges = 0;
+        return;
+    }
+
+    EngineFrame* back = renderer->back;
+    renderer->back = renderer->scratch;
+    renderer->scratch = back;
+
+    unsigned char* quality = renderer->quality;
+    renderer->quality = renderer->scratch_quality;
+    renderer->scratch_quality = quality;
+
+    if (resized) {
+        resize_frame(&renderer->scratch,
+                     &renderer->scratch_quality,
+                     params->width,
+                     params->height);
+    }
+
+    publish(renderer, params);
+}
+
+static gpointer render_thread(gpointer data) {
+    Renderer* renderer = data;
+    EngineParams params;
+    double complex* roots = NULL;
+
+    // Whether `params` was last rendered interactively, and still needs a
+    // full quality frame.
+    bool settling = false;
+
+    while (true) {
+        g_mutex_lock(&renderer->mutex);
+        gint64 idle_deadline = g_get_monotonic_time() + RENDERER_IDLE_DELAY;
+        while (!renderer->has_pending && !renderer->quit) {
+            if (!settling) {
+                g_cond_wait(&renderer->cond, &renderer->mutex);
+            } else if (!g_cond_wait_until(
+                           &renderer->cond, &renderer->mutex, idle_deadline)) {
+                break;
+            }
+        }
+        if (renderer->quit) {
+            g_mutex_unlock(&renderer->mutex);
+            break;
+        }
+
+        bool interactive = false;
+        if (renderer->has_pending) {
+            params = renderer->pending;
+            copy_roots(
+                &roots, renderer->pending_roots, params.newton_num_roots);
+            params.newton_roots = roots;
+            params.cancel = &renderer->cancel;
+            params.reference = renderer->reference;
+            params.newton_index = renderer->newton_index;
+            interactive = renderer->pending_interactive;
+            renderer->has_pending = false;
+        }
+        settling = interactive;
+        atomic_store(&renderer->cancel, false);
+        g_mutex_unlock(&renderer->mutex);
+
+        // Frames that only change the coloring of the last complete one are
+        // colored again without iterating anything.
+        if (renderer->shown_complete &&
+            engine_same_samples(&renderer->shown, &params)) {
+            renderer->shown.palette = params.palette;
+            renderer->shown.color_ramp = params.color_ramp;
+            publish(renderer, &renderer->shown);
+            continue;
+        }
+
+        EngineParams frame = params;
+        if (interactive) {
+            double scale = renderer->iteration_scale;
+            frame.max_iter = fmax(round(params.max_iter * scale), 1);
+            frame.newton_iterations =
+                fmax(round(params.newton_iterations * scale), 1);
+        }
+
+        reproject(renderer, &frame);
+        frame.quality = renderer->quality;
+
+        // The quality buffer tracks what every pixel holds, so even a
+        // cancelled frame is worth reprojecting.
+        renderer->shown = frame;
+        copy_roots(&renderer->shown_roots, roots, frame.newton_num_roots);
+        renderer->shown.newton_roots = renderer->shown_roots;
+        renderer->has_shown = true;
+        renderer->shown_complete = false;
+
+        // Interactive frames bypass the cache, which would otherwise fill up
+        // with tiles at reduced iterations.
+        if (interactive) {
+            render_interactive(renderer, &frame);
+        } else if (tile_cache_supports(&frame)) {
+            renderer->shown_complete = render_cached(renderer, &frame);
+        } else {
+            renderer->shown_complete = render_progressive(renderer, &frame);
+        }
+
+        // Edges get antialiased once the rest of the frame is exact.
+        if (renderer->shown_complete && engine_antialias(&frame) > 1) {
+            renderer->shown_complete =
+                antialias_frame(&frame, renderer->back, NULL);
+            if (renderer->shown_complete)
+                publish(renderer, &frame);
+        }
+    }
+
+    free(roots);
+    return NULL;
+}
+
+Renderer* renderer_new(unsigned int width,
+                       unsigned int height,
+                       void (*on_frame)(gpointer data),
+                       gpointer data) {
+    Renderer* renderer = malloc(sizeof(Renderer));
+    *renderer = (Renderer){
+        .width = width,
+        .height = height,
+        .front = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height),
+        .next = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height),
+        .back = engine_frame_new(width, height),
+        .quality = malloc(width * height),
+        .scratch = engine_frame_new(width, height),
+        .scratch_quality = malloc(width * height),
+        .cache = tile_cache_new(TILE_CACHE_CAPACITY),
+        .reference = reference_orbit_new(),
+        .newton_index = newton_index_new(),
+        .iteration_scale = 1,
+        .on_frame = on_frame,
+        .data = data,
+    };
+
+    g_mutex_init(&renderer->mutex);
+    g_cond_init(&renderer->cond);
+    atomic_init(&renderer->cancel, false);
+    atomic_init(&renderer->frame_queued, false);
+
+    renderer->thread = g_thread_new("renderer", render_thread, renderer);
+
+    return renderer;
+}
+
+static void submit(Renderer* renderer,
+                   const EngineParams* params,
+                   bool interactive) {
+    g_mutex_lock(&renderer->mutex);
+    if (renderer->has_submitted &&
+        renderer->pending_interactive == interactive &&
+        engine_same_frame(&renderer->pending, params)) {
+        g_mutex_unlock(&renderer->mutex);
+        return;
+    }
+
+    atomic_store(&renderer->cancel, true);
+    renderer->pending = *params;
+    copy_roots(&renderer->pending_roots,
+               params->newton_roots,
+               params->newton_num_roots);
+    renderer->pending.newton_roots = renderer->pending_roots;
+    renderer->has_submitted = true;
+    renderer->has_pending = true;
+    renderer->pending_interactive = interactive;
+    g_cond_signal(&renderer->cond);
+    g_mutex_unlock(&renderer->mutex);
+}
+
+void renderer_submit(Renderer* renderer, const EngineParams* params) {
+    submit(renderer, params, false);
+}
+
+void renderer_submit_interactive(Renderer* renderer,
+                                 const EngineParams* params) {
+    submit(renderer, params, true);
+}
+
+void renderer_draw(Renderer* renderer,
+                   cairo_t* cr,
+                   unsigned int width,
+                   unsigned int height) {
+    g_mutex_lock(&renderer->mutex);
+    cairo_save(cr);
+    cairo_scale(cr,
+                (double)width / cairo_image_surface_get_width(renderer->front),
+                (double)height /
+                    cairo_image_surface_get_height(renderer->front));
+    cairo_set_source_surface(cr, renderer->front, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_BILINEAR);
+    cairo_paint(cr);
+    cairo_restore(cr);
+    g_mutex_unlock(&renderer->mutex);
+}
+
+void renderer_free(Renderer* renderer) {
+    atomic_store(&renderer->cancel, true);
+
+    g_mutex_lock(&renderer->mutex);
+    renderer->quit = true;
+    g_cond_signal(&renderer->cond);
+    g_mutex_unlock(&renderer->mutex);
+
+    g_thread_join(renderer->thread);
+
+    if (renderer->frame_source != 0)
+        g_source_remove(renderer->frame_source);
+
+    g_mutex_clear(&renderer->mutex);
+    g_cond_clear(&renderer->cond);
+    free(renderer->pending_roots);
+    free(renderer->shown_roots);
+    tile_cache_free(renderer->cache);
+    reference_orbit_free(renderer->reference);
+    newton_index_free(renderer->newton_index);
+    free(renderer->scratch_quality);
+    engine_frame_free(renderer->scratch);
+    free(renderer->quality);
+    engine_frame_free(renderer->back);
+    cairo_surface_destroy(renderer->next);
+    cairo_surface_destroy(renderer->front);
+    free(renderer);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <gtk/gtk.h>
+
+#include "engine.h"
+
+#define RENDERER_FIRST_BLOCK 8
+
+// Interactive frames aim to render within this many microseconds, and get
+// rendered again at full quality once no submission has come for
+// RENDERER_IDLE_DELAY microseconds.
+#define RENDERER_FRAME_BUDGET 16000
+#define RENDERER_IDLE_DELAY 150000
+
+// Interactive frames run at least this fraction of the iterations.
+#define RENDERER_MIN_ITERATION_SCALE (1.0 / 16)
+
+typedef struct Renderer Renderer;
+
+// Creates a background render thread that progressively renders the latest
+// submitted params, calling `on_frame` on the main loop every time a new
+// pass is available to draw. Frames start at `width` x `height`, and follow
+// the size of the params submitted.
+Renderer* renderer_new(unsigned int width,
+                       unsigned int height,
+                       void (*on_frame)(gpointer data),
+                       gpointer data);
+
+// Cancels the render in progress, if any, and schedules `params`. Bursts of
+// submissions are coalesced: only the latest one gets rendered.
+void renderer_submit(Renderer* renderer, const EngineParams* params);
+
+// Same as renderer_submit(), for params that keep changing while the user
+// drags or holds a key. The frame stops refining, and runs fewer iterations,
+// as needed to fit RENDERER_FRAME_BUDGET, and the last one gets rendered at
+// full quality once the input goes idle.
+void renderer_submit_interactive(Renderer* renderer,
+                                 const EngineParams* params);
+
+// Paints the latest pass at the origin of `cr`, scaled to `width` x
+// `height`, so that frames rendered at any resolution fill the same area.
+// The render thread keeps going meanwhile, on a surface of its own.
+void renderer_draw(Renderer* renderer,
+                   cairo_t* cr,
+                   unsigned int width,
+                   unsigned int height);
+
+void renderer_free(Renderer* renderer);
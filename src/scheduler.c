@@ -0,0 +1,139 @@
+#include "scheduler.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+
+// The queue of a thread holds the tasks `thread + k * num_threads` for every
+// k in [head, tail). Both ends live in one word so that the owner popping
+// the head and thieves popping the tail never hand out the same task.
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t range;
+} Queue;
+
+#define RANGE(head, tail) (((uint_fast64_t)(head) << 32) | (tail))
+#define RANGE_HEAD(range) ((unsigned int)((range) >> 32))
+#define RANGE_TAIL(range) ((unsigned int)((range) & 0xffffffff))
+
+// Takes one task from the front of `queue`, or from its back when `steal`.
+// Returns false once the queue is empty.
+static bool queue_pop(Queue* queue, bool steal, unsigned int* k) {
+    uint_fast64_t range = atomic_load(&queue->range);
+    while (true) {
+        unsigned int head = RANGE_HEAD(range);
+        unsigned int tail = RANGE_TAIL(range);
+        if (head >= tail)
+            return false;
+
+        uint_fast64_t next =
+            steal ? RANGE(head, tail - 1) : RANGE(head + 1, tail);
+        if (atomic_compare_exchange_weak(&queue->range, &range, next)) {
+            *k = steal ? tail - 1 : head;
+            return true;
+        }
+    }
+}
+
+uint64_t scheduler_run(unsigned int count,
+                       uint64_t (*run)(void* data, unsigned int task),
+                       void* data,
+                       SchedulerStats* stats) {
+    unsigned int num_threads = omp_get_max_threads();
+    if (num_threads > SCHEDULER_MAX_THREADS)
+        num_threads = SCHEDULER_MAX_THREADS;
+    if (num_threads > count)
+        num_threads = count > 0 ? count : 1;
+
+    Queue* queues =
+        aligned_alloc(_Alignof(Queue), num_threads * sizeof(Queue));
+    for (unsigned int thread = 0; thread < num_threads; thread++) {
+        unsigned int length = count / num_threads +
+                              (thread < count % num_threads ? 1 : 0);
+        atomic_init(&queues[thread].range, RANGE(0, length));
+    }
+
+    if (stats != NULL) {
+        memset(stats, 0, sizeof(*stats));
+        stats->num_threads = num_threads;
+    }
+
+    uint64_t total = 0;
+
+#pragma omp parallel num_threads(num_threads) reduction(+ : total)
+    {
+        unsigned int thread = omp_get_thread_num();
+        unsigned int tasks = 0;
+        unsigned int steals = 0;
+        double busy = 0;
+
+        for (unsigned int i = 0; i < num_threads; i++) {
+            unsigned int victim = (thread + i) % num_threads;
+            unsigned int k;
+
+            while (queue_pop(&queues[victim], victim != thread, &k)) {
+                double start = omp_get_wtime();
+                total += run(data, victim + k * num_threads);
+                busy += omp_get_wtime() - start;
+
+                tasks++;
+                if (victim != thread)
+                    steals++;
+            }
+        }
+
+        if (stats != NULL) {
+            stats->busy[thread] = busy;
+            stats->tasks[thread] = tasks;
+            stats->steals[thread] = steals;
+        }
+    }
+
+    free(queues);
+    return total;
+}
+
+static int compare_keys(const void* a, const void* b) {
+    uint64_t key_a = *(const uint64_t*)a;
+    uint64_t key_b = *(const uint64_t*)b;
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+void scheduler_order_from_center(unsigned int columns,
+                                 unsigned int rows,
+                                 unsigned int* order) {
+    unsigned int count = columns * rows;
+    uint64_t* keys = malloc(count * sizeof(uint64_t));
+
+    for (unsigned int y = 0; y < rows; y++) {
+        for (unsigned int x = 0; x < columns; x++) {
+            // Distances are doubled to stay integers on even grids.
+            int64_t dx = 2 * (int64_t)x + 1 - columns;
+            int64_t dy = 2 * (int64_t)y + 1 - rows;
+            uint64_t distance = dx * dx + dy * dy;
+            keys[y * columns + x] = distance << 32 | (y * columns + x);
+        }
+    }
+
+    qsort(keys, count, sizeof(uint64_t), compare_keys);
+
+    for (unsigned int i = 0; i < count; i++) {
+        order[i] = keys[i] & 0xffffffff;
+    }
+
+    free(keys);
+}
+
+double scheduler_imbalance(const SchedulerStats* stats) {
+    double total = 0;
+    double busiest = 0;
+    for (unsigned int thread = 0; thread < stats->num_threads; thread++) {
+        total += stats->busy[thread];
+        if (stats->busy[thread] > busiest)
+            busiest = stats->busy[thread];
+    }
+
+    return total > 0 ? busiest * stats->num_threads / total : 1;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#define SCHEDULER_MAX_THREADS 256
+
+typedef struct {
+    unsigned int num_threads;
+
+    // Per thread: seconds spent running tasks, tasks run, and how many of
+    // them were stolen from another thread's queue.
+    double busy[SCHEDULER_MAX_THREADS];
+    unsigned int tasks[SCHEDULER_MAX_THREADS];
+    unsigned int steals[SCHEDULER_MAX_THREADS];
+} SchedulerStats;
+
+// Runs `run(data, task)` for every task in [0, `count`) on the OpenMP
+// threads, and returns the sum of what the calls returned. Tasks are dealt
+// round robin, so each thread starts on the lowest tasks it was dealt. A
+// thread whose queue runs dry steals from the end of the other queues.
+// `stats` may be NULL.
+uint64_t scheduler_run(unsigned int count,
+                       uint64_t (*run)(void* data, unsigned int task),
+                       void* data,
+                       SchedulerStats* stats);
+
+// Fills `order` with the cells of a `columns` x `rows` grid, as row-major
+// indices, from the centre outwards.
+void scheduler_order_from_center(unsigned int columns,
+                                 unsigned int rows,
+                                 unsigned int* order);
+
+// Ratio between the busiest thread's time and the mean time.
+double scheduler_imbalance(const SchedulerStats* stats);
@@ -3,27 +3,29 @@
 #include <complex.h>
 #include <gtk/gtk.h>
 
+#include "bignum.h"
+#include "engine.h"
 #include "pixel.h"
+#include "renderer.h"
 #include "window.h"
 
-typedef enum {
-    FRACTAL_MANDELBROT,
-    FRACTAL_JULIA,
-    FRACTAL_NEWTON,
-} FRACTAL_TYPE;
+// Overlays cached in a surface of their own. See overlays.h.
+typedef struct OverlayLayer OverlayLayer;
 
 typedef struct {
-    char _placeholder;
+    bool subdivide;
 } MandelbrotConfig;
 
 typedef struct {
     Pixel z0;
+    bool subdivide;
 } JuliaConfig;
 
 typedef struct {
     double complex* roots;
     unsigned int num_roots;
     unsigned int iterations;
+    bool subdivide;
 } NewtonConfig;
 
 typedef struct {
@@ -33,18 +35,26 @@ typedef struct {
 } FractalsConfig;
 
 typedef struct State {
-    guchar* pixels;
     Window* window;
+    Renderer* renderer;
 
     FRACTAL_TYPE fractal_type;
     FractalsConfig fractals_config;
 
     int max_iter;
+    PALETTE_TYPE palette;
+    unsigned int color_ramp;
+    unsigned int antialias;
+    double render_scale;
 
     double complex_width;
     Pixel screen_center;
 
+    // `screen_center` at full precision, for zooms past what doubles hold.
+    BigComplex deep_center;
+
     bool show_overlays;
     float overlays_color[3];
+    OverlayLayer* overlay_layer;
     double tick_step;
 } State;
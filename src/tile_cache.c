@@ -0,0 +1,416 @@
+#include "tile_cache.h"
+#include <complex.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "scheduler.h"
+
+#define MAX_EXACT_GRID_COORDINATE 4503599627370496.0  // 2^52
+
+typedef struct {
+    FRACTAL_TYPE fractal_type;
+    int max_iter;
+    double complex julia_c;
+    uint64_t newton_roots_hash;
+    unsigned int newton_num_roots;
+    unsigned int newton_iterations;
+    PRECISION_TYPE precision;
+
+    // Subdivided tiles fill rectangles without iterating their inside, and
+    // aren't exact enough for views that ask for every pixel.
+    bool subdivide;
+    double step;
+    int64_t tile_x;
+    int64_t tile_y;
+} TileKey;
+
+typedef struct Tile Tile;
+
+struct Tile {
+    TileKey key;
+    uint64_t hash;
+
+    // Block size of the finest completed pass, 0 if nothing is computed yet.
+    unsigned int level;
+    int32_t values[TILE_SIZE * TILE_SIZE];
+    float magnitudes[TILE_SIZE * TILE_SIZE];
+
+    Tile* next_in_bucket;
+    Tile* lru_previous;
+    Tile* lru_next;
+};
+
+struct TileCache {
+    unsigned int capacity;
+    unsigned int size;
+
+    unsigned int num_buckets;
+    Tile** buckets;
+
+    Tile* lru_first;
+    Tile* lru_last;
+
+    Tile** view_tiles;
+    unsigned int view_tiles_capacity;
+};
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t length) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Only the parameters that affect the current fractal are part of the key,
+// so that toggling between fractals hits the tiles left by the others.
+static TileKey tile_key(const EngineParams* params,
+                        int64_t tile_x,
+                        int64_t tile_y) {
+    TileKey key;
+    memset(&key, 0, sizeof(key));
+
+    key.fractal_type = params->fractal_type;
+    key.precision = engine_precision(params);
+    key.subdivide = params->subdivide;
+    key.step = engine_step(params);
+    key.tile_x = tile_x;
+    key.tile_y = tile_y;
+
+    if (params->fractal_type == FRACTAL_NEWTON) {
+        key.newton_roots_hash =
+            hash_bytes(14695981039346656037ull,
+                       params->newton_roots,
+                       params->newton_num_roots * sizeof(double complex));
+        key.newton_num_roots = params->newton_num_roots;
+        key.newton_iterations = params->newton_iterations;
+    } else {
+        key.max_iter = params->max_iter;
+    }
+
+    if (params->fractal_type == FRACTAL_JULIA)
+        key.julia_c = params->julia_c;
+
+    return key;
+}
+
+static void lru_unlink(TileCache* cache, Tile* tile) {
+    if (tile->lru_previous != NULL)
+        tile->lru_previous->lru_next = tile->lru_next;
+    else
+        cache->lru_first = tile->lru_next;
+
+    if (tile->lru_next != NULL)
+        tile->lru_next->lru_previous = tile->lru_previous;
+    else
+        cache->lru_last = tile->lru_previous;
+}
+
+static void lru_push_front(TileCache* cache, Tile* tile) {
+    tile->lru_previous = NULL;
+    tile->lru_next = cache->lru_first;
+    if (cache->lru_first != NULL)
+        cache->lru_first->lru_previous = tile;
+    else
+        cache->lru_last = tile;
+    cache->lru_first = tile;
+}
+
+static void bucket_remove(TileCache* cache, Tile* tile) {
+    Tile** link = &cache->buckets[tile->hash % cache->num_buckets];
+    while (*link != tile) {
+        link = &(*link)->next_in_bucket;
+    }
+    *link = tile->next_in_bucket;
+}
+
+static uint64_t key_hash(const TileKey* key) {
+    return hash_bytes(14695981039346656037ull, key, sizeof(*key));
+}
+
+static Tile* tile_cache_find(TileCache* cache,
+                             const TileKey* key,
+                             uint64_t hash) {
+    for (Tile* tile = cache->buckets[hash % cache->num_buckets]; tile != NULL;
+         tile = tile->next_in_bucket) {
+        if (tile->hash == hash && memcmp(&tile->key, key, sizeof(*key)) == 0)
+            return tile;
+    }
+    return NULL;
+}
+
+static int64_t floor_div(int64_t value, int64_t divisor) {
+    int64_t quotient = value / divisor;
+    if (value % divisor != 0 && value < 0)
+        quotient--;
+    return quotient;
+}
+
+static Tile* tile_cache_get(TileCache* cache, const TileKey* key) {
+    uint64_t hash = key_hash(key);
+
+    Tile* tile = tile_cache_find(cache, key, hash);
+    if (tile != NULL) {
+        lru_unlink(cache, tile);
+        lru_push_front(cache, tile);
+        return tile;
+    }
+
+    if (cache->size < cache->capacity) {
+        tile = malloc(sizeof(Tile));
+        cache->size++;
+    } else {
+        tile = cache->lru_last;
+        lru_unlink(cache, tile);
+        bucket_remove(cache, tile);
+    }
+
+    unsigned int bucket = hash % cache->num_buckets;
+    tile->key = *key;
+    tile->hash = hash;
+    tile->level = 0;
+    tile->next_in_bucket = cache->buckets[bucket];
+    cache->buckets[bucket] = tile;
+    lru_push_front(cache, tile);
+
+    return tile;
+}
+
+static bool refine_tile(const EngineParams* params,
+                        Tile* tile,
+                        unsigned int block,
+                        uint64_t* iterations) {
+    bool refine = tile->level == 2 * block;
+    double step = engine_step(params);
+    double grid_x = (double)tile->key.tile_x * TILE_SIZE;
+    double grid_y = (double)tile->key.tile_y * TILE_SIZE;
+
+    if (block == 1 && params->subdivide) {
+        engine_subdivide(params,
+                         step,
+                         grid_x,
+                         grid_y,
+                         TILE_SIZE,
+                         TILE_SIZE,
+                         refine ? 2 : 0,
+                         tile->values,
+                         tile->magnitudes,
+                         iterations);
+        tile->level = 1;
+        return true;
+    }
+
+    for (unsigned int y = 0; y < TILE_SIZE; y += block) {
+        if (engine_cancelled(params))
+            return false;
+
+        // A row of a tile always fits in one batch.
+        unsigned int xs[TILE_SIZE];
+        int32_t values[TILE_SIZE];
+        float magnitudes[TILE_SIZE];
+        unsigned int count = 0;
+
+        for (unsigned int x = 0; x < TILE_SIZE; x += block) {
+            if (refine && x % (2 * block) == 0 && y % (2 * block) == 0)
+                continue;
+            xs[count++] = x;
+        }
+
+        engine_sample_scanline(params,
+                               step,
+                               grid_x,
+                               grid_y + y,
+                               xs,
+                               count,
+                               values,
+                               magnitudes,
+                               iterations);
+
+        for (unsigned int by = y; by < y + block && by < TILE_SIZE; by++) {
+            int32_t* row = &tile->values[by * TILE_SIZE];
+            float* row_magnitudes = &tile->magnitudes[by * TILE_SIZE];
+            for (unsigned int i = 0; i < count; i++) {
+                for (unsigned int bx = xs[i];
+                     bx < xs[i] + block && bx < TILE_SIZE;
+                     bx++) {
+                    row[bx] = values[i];
+                    row_magnitudes[bx] = magnitudes[i];
+                }
+            }
+        }
+    }
+
+    tile->level = block;
+    return true;
+}
+
+static void blit_tile(const EngineParams* params,
+                      const Tile* tile,
+                      int64_t origin_x,
+                      int64_t origin_y,
+                      EngineFrame* frame) {
+    int64_t left = tile->key.tile_x * TILE_SIZE - origin_x;
+    int64_t top = tile->key.tile_y * TILE_SIZE - origin_y;
+    unsigned int level = tile->level;
+
+    for (int64_t y = top < 0 ? 0 : top;
+         y < top + TILE_SIZE && y < params->height;
+         y++) {
+        for (int64_t x = left < 0 ? 0 : left;
+             x < left + TILE_SIZE && x < params->width;
+             x++) {
+            unsigned int tile_x = x - left;
+            unsigned int tile_y = y - top;
+
+            if (params->quality != NULL) {
+                unsigned char* quality =
+                    &params->quality[y * params->width + x];
+                if (tile_x % level == 0 && tile_y % level == 0) {
+                    *quality = ENGINE_QUALITY_EXACT;
+                } else if (level < *quality) {
+                    *quality = level;
+                } else {
+                    continue;
+                }
+            }
+
+            unsigned int index = y * params->width + x;
+            frame->values[index] = tile->values[tile_y * TILE_SIZE + tile_x];
+            frame->magnitudes[index] =
+                tile->magnitudes[tile_y * TILE_SIZE + tile_x];
+        }
+    }
+}
+
+typedef struct {
+    TileCache* cache;
+    const EngineParams* params;
+    EngineFrame* frame;
+    unsigned int block;
+    int64_t origin_x;
+    int64_t origin_y;
+} ViewPass;
+
+static uint64_t render_view_tile(void* data, unsigned int task) {
+    const ViewPass* pass = data;
+    Tile* tile = pass->cache->view_tiles[task];
+    uint64_t iterations = 0;
+
+    if (tile->level == 0 || tile->level > pass->block)
+        refine_tile(pass->params, tile, pass->block, &iterations);
+
+    // A tile whose first pass got cancelled holds nothing to show.
+    if (tile->level != 0) {
+        blit_tile(pass->params,
+                  tile,
+                  pass->origin_x,
+                  pass->origin_y,
+                  pass->frame);
+    }
+
+    return iterations;
+}
+
+TileCache* tile_cache_new(unsigned int capacity) {
+    TileCache* cache = malloc(sizeof(TileCache));
+    *cache = (TileCache){
+        .capacity = capacity,
+        .num_buckets = capacity,
+        .buckets = calloc(capacity, sizeof(Tile*)),
+    };
+
+    return cache;
+}
+
+bool tile_cache_supports(const EngineParams* params) {
+    if (engine_is_deep(params))
+        return false;
+
+    double origin_x, origin_y;
+    engine_view_origin(params, &origin_x, &origin_y);
+
+    return fabs(origin_x) + params->width < MAX_EXACT_GRID_COORDINATE &&
+           fabs(origin_y) + params->height < MAX_EXACT_GRID_COORDINATE;
+}
+
+bool tile_cache_render(TileCache* cache,
+                       const EngineParams* params,
+                       EngineFrame* frame,
+                       unsigned int block,
+                       EngineStats* stats) {
+    double origin_x, origin_y;
+    engine_view_origin(params, &origin_x, &origin_y);
+
+    int64_t first_x = floor_div(origin_x, TILE_SIZE);
+    int64_t first_y = floor_div(origin_y, TILE_SIZE);
+    int64_t last_x = floor_div(origin_x + params->width - 1, TILE_SIZE);
+    int64_t last_y = floor_div(origin_y + params->height - 1, TILE_SIZE);
+    unsigned int columns = last_x - first_x + 1;
+    unsigned int rows = last_y - first_y + 1;
+    unsigned int count = columns * rows;
+
+    // Every tile of the view must stay in the cache for the whole pass.
+    if (count > cache->capacity)
+        cache->capacity = count;
+
+    if (count > cache->view_tiles_capacity) {
+        cache->view_tiles = realloc(cache->view_tiles, count * sizeof(Tile*));
+        cache->view_tiles_capacity = count;
+    }
+
+    // Tiles are gathered from the centre outwards, which is the order they
+    // get rendered in.
+    unsigned int* order = malloc(count * sizeof(unsigned int));
+    scheduler_order_from_center(columns, rows, order);
+    for (unsigned int i = 0; i < count; i++) {
+        TileKey key = tile_key(params,
+                               first_x + order[i] % columns,
+                               first_y + order[i] / columns);
+        cache->view_tiles[i] = tile_cache_get(cache, &key);
+    }
+    free(order);
+
+    EngineParams pass_params;
+    engine_pass_begin(params, &pass_params);
+
+    ViewPass pass = {
+        .cache = cache,
+        .params = &pass_params,
+        .frame = frame,
+        .block = block,
+        .origin_x = origin_x,
+        .origin_y = origin_y,
+    };
+    uint64_t iterations = scheduler_run(count,
+                                        render_view_tile,
+                                        &pass,
+                                        stats != NULL ? &stats->threads : NULL);
+    engine_pass_end(params, &pass_params);
+
+    bool complete = true;
+    for (unsigned int i = 0; i < count; i++) {
+        complete = complete && cache->view_tiles[i]->level == 1;
+    }
+
+    if (stats != NULL)
+        stats->iterations = iterations;
+
+    return complete;
+}
+
+void tile_cache_free(TileCache* cache) {
+    for (Tile* tile = cache->lru_first; tile != NULL;) {
+        Tile* next = tile->lru_next;
+        free(tile);
+        tile = next;
+    }
+
+    free(cache->view_tiles);
+    free(cache->buckets);
+    free(cache);
+}
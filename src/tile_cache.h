@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "engine.h"
+
+#define TILE_SIZE 32
+#define TILE_CACHE_CAPACITY 4096
+
+typedef struct TileCache TileCache;
+
+TileCache* tile_cache_new(unsigned int capacity);
+
+// Whether the view can be split into cached tiles. Beyond 2^52 grid steps
+// from the origin, the grid coordinates are no longer exact integers, and
+// deep views have grids of their own.
+bool tile_cache_supports(const EngineParams* params);
+
+// Brings every tile covering the view to at least `block` refinement,
+// computing only what the cache doesn't already hold, and copies the view
+// into `frame`. Pixels that `params->quality` rates better than their tile
+// are left alone. Returns true when the view is fully refined.
+bool tile_cache_render(TileCache* cache,
+                       const EngineParams* params,
+                       EngineFrame* frame,
+                       unsigned int block,
+                       EngineStats* stats);
+
+void tile_cache_free(TileCache* cache);
@@ -6,8 +6,6 @@
 typedef struct {
     Window* window;
     char* name;
-    unsigned int size;
-    guchar* pixels;
     void (*draw)(GtkDrawingArea* drawing_area,
                  cairo_t* cr,
                  int width,
@@ -27,6 +25,38 @@ typedef struct {
                           gpointer _data);
 } WindowActivationParams;
 
+static void update_size(Window* window) {
+    GtkWidget* widget = GTK_WIDGET(window->drawing_area);
+    unsigned int width = gtk_widget_get_width(widget);
+    unsigned int height = gtk_widget_get_height(widget);
+    unsigned int scale = gtk_widget_get_scale_factor(widget);
+    if (width == 0 || height == 0)
+        return;
+    if (width == window->width && height == window->height &&
+        scale == window->scale)
+        return;
+
+    unsigned int previous_width = window->width;
+    window->width = width;
+    window->height = height;
+    window->scale = scale;
+    if (window->on_resize != NULL)
+        window->on_resize(previous_width);
+}
+
+static void drawing_area_resized(GtkDrawingArea* drawing_area,
+                                 int width,
+                                 int height,
+                                 gpointer data) {
+    update_size(data);
+}
+
+static void scale_factor_changed(GObject* object,
+                                 GParamSpec* param_spec,
+                                 gpointer data) {
+    update_size(data);
+}
+
 static void activate(GtkApplication* app, WindowActivationParams* params) {
     Window* window = params->window;
 
@@ -35,12 +65,19 @@ static void activate(GtkApplication* app, WindowActivationParams* params) {
 
     gtk_window_set_title(GTK_WINDOW(window->app_window), params->name);
     gtk_window_set_default_size(
-        GTK_WINDOW(window->app_window), params->size, params->size + 36);
-    gtk_window_set_resizable(GTK_WINDOW(window->app_window), false);
+        GTK_WINDOW(window->app_window), window->width, window->height + 36);
 
     window->drawing_area = GTK_DRAWING_AREA(gtk_drawing_area_new());
     gtk_drawing_area_set_draw_func(
         window->drawing_area, params->draw, NULL, NULL);
+    g_signal_connect(window->drawing_area,
+                     "resize",
+                     G_CALLBACK(drawing_area_resized),
+                     window);
+    g_signal_connect(window->drawing_area,
+                     "notify::scale-factor",
+                     G_CALLBACK(scale_factor_changed),
+                     window);
 
     gtk_window_set_child(GTK_WINDOW(window->app_window),
                          GTK_WIDGET(window->drawing_area));
@@ -56,6 +93,7 @@ static void activate(GtkApplication* app, WindowActivationParams* params) {
                               window->event_controller);
 
     window->drag_gesture = gtk_gesture_drag_new();
+    gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(window->drag_gesture), 0);
     g_signal_connect(window->drag_gesture,
                      "drag-update",
                      G_CALLBACK(params->on_drag_update),
@@ -73,13 +111,14 @@ static void activate(GtkApplication* app, WindowActivationParams* params) {
 }
 
 Window* window_new(char* name,
-                   unsigned int size,
-                   guchar* pixels,
+                   unsigned int width,
+                   unsigned int height,
                    void (*draw)(GtkDrawingArea* drawing_area,
                                 cairo_t* cr,
                                 int width,
                                 int height,
                                 gpointer _data),
+                   void (*on_resize)(unsigned int previous_width),
                    gboolean (*on_key_press)(GtkEventControllerKey* controller,
                                             guint keyval,
                                             guint keycode,
@@ -94,10 +133,8 @@ Window* window_new(char* name,
                                           gpointer _data)) {
     WindowActivationParams* params = malloc(sizeof(WindowActivationParams));
     *params = (WindowActivationParams){
-        .window = malloc(sizeof(Window)),
+        .window = calloc(1, sizeof(Window)),
         .name = name,
-        .size = size,
-        .pixels = pixels,
         .draw = draw,
         .on_key_press = on_key_press,
         .on_drag_update = on_drag_update,
@@ -110,8 +147,10 @@ Window* window_new(char* name,
     g_signal_connect(
         window->app, "activate", G_CALLBACK(activate), (gpointer)params);
 
-    window->size = size;
-    window->pixels = pixels;
+    window->width = width;
+    window->height = height;
+    window->scale = 1;
+    window->on_resize = on_resize;
 
     return window;
 }
@@ -3,8 +3,15 @@
 #include <gtk/gtk.h>
 
 typedef struct {
-    unsigned int size;
-    guchar* pixels;
+    // Size of the drawing area in logical pixels, and the device pixels per
+    // logical pixel of the monitor it shows on. Kept up to date as the
+    // window gets resized or moved to another monitor, which calls
+    // `on_resize` with the width the drawing area had before.
+    unsigned int width;
+    unsigned int height;
+    unsigned int scale;
+    void (*on_resize)(unsigned int previous_width);
+
     GtkApplication* app;
     GtkApplicationWindow* app_window;
     GtkDrawingArea* drawing_area;
@@ -13,13 +20,14 @@ typedef struct {
 } Window;
 
 Window* window_new(char* name,
-                   unsigned int size,
-                   guchar* data,
+                   unsigned int width,
+                   unsigned int height,
                    void (*draw)(GtkDrawingArea* drawing_area,
                                 cairo_t* cr,
                                 int width,
                                 int height,
                                 gpointer _data),
+                   void (*on_resize)(unsigned int previous_width),
                    gboolean (*on_key_press)(GtkEventControllerKey* controller,
                                             guint keyval,
                                             guint keycode,
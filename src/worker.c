@@ -0,0 +1,109 @@
+#include "worker.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "kernel.h"
+#include "newton.h"
+#include "perturbation.h"
+#include "protocol.h"
+
+// Whether `a` and `b` are bands of the same image, see
+// EngineParams.full_height.
+static bool same_image(const EngineParams* a, const EngineParams* b) {
+    EngineParams band = *b;
+    band.height = a->height;
+    band.band_top = a->band_top;
+    return engine_same_samples(a, &band);
+}
+
+// Renders the jobs of one coordinator until it disconnects.
+static void serve(int socket) {
+    Message message = {0};
+    EngineFrame* frame = NULL;
+    ReferenceOrbit* reference = NULL;
+    NewtonIndex* newton_index = newton_index_new();
+
+    // The image the last job came from, whose reference orbit the next
+    // jobs of the same image share.
+    ProtocolJob last = {0};
+    bool has_last = false;
+
+    ProtocolJob job;
+    while (protocol_receive(socket, &message) &&
+           protocol_get_job(&message, &job)) {
+        // Kernels all give the same iterations, so each worker picks the
+        // best of its own CPU.
+        job.params.kernel = kernel_best();
+
+        // A new image gets its own reference, as it would rendering locally.
+        if (!has_last || !same_image(&last.params, &job.params)) {
+            if (reference != NULL)
+                reference_orbit_free(reference);
+            reference = reference_orbit_new();
+        }
+        protocol_job_free(&last);
+        last = job;
+        has_last = true;
+
+        // Only the rows of the job are rendered, as a band of their own.
+        // Jobs start on the tiles of the whole image, so subdivision finds
+        // the same rectangles as there.
+        EngineParams band = job.params;
+        band.height = job.rows;
+        band.band_top = job.params.band_top + job.top;
+        band.full_height = engine_full_height(&job.params);
+        band.reference = reference;
+        band.newton_index = newton_index;
+
+        if (frame == NULL || frame->width != band.width ||
+            frame->height != band.height) {
+            if (frame != NULL)
+                engine_frame_free(frame);
+            frame = engine_frame_new(band.width, band.height);
+        }
+
+        EngineStats stats = {0};
+        engine_render_pass(&band, frame, 1, false, &stats);
+
+        protocol_put_tile(
+            &message, job.id, stats.iterations, frame, 0, job.rows);
+        if (!protocol_send(socket, &message))
+            break;
+    }
+
+    protocol_job_free(&last);
+    newton_index_free(newton_index);
+    if (reference != NULL)
+        reference_orbit_free(reference);
+    if (frame != NULL)
+        engine_frame_free(frame);
+    message_free(&message);
+}
+
+int worker_main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: main.out --worker unix:PATH|HOST:PORT\n");
+        return 1;
+    }
+
+    int listener = protocol_listen(argv[1]);
+    if (listener < 0) {
+        fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "Worker listening on %s\n", argv[1]);
+
+    for (;;) {
+        int socket = protocol_accept(listener);
+        if (socket < 0) {
+            fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+            continue;
+        }
+        serve(socket);
+        close(socket);
+    }
+}
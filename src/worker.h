@@ -0,0 +1,6 @@
+#pragma once
+
+// Headless entry point for `main.out --worker ADDRESS`. Listens on
+// ADDRESS, see protocol_connect(), and renders the tiles coordinators send
+// until killed, serving one coordinator at a time.
+int worker_main(int argc, char* argv[]);